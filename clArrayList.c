@@ -103,3 +103,305 @@ clArrayList_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
 	return al;
 }
 
+
+/**
+ * clArrayList_scratch_size() - Local memory clArrayList_grow_local needs
+ * @dev: Device
+ * @kernel: Kernel calling clArrayList_grow_local
+ * @local: Work-group size, 0 if left to the implementation
+ * @return Size in bytes to pass to clSetKernelArg for the scratch argument
+ */
+size_t
+clArrayList_scratch_size(cl_device_id dev, cl_kernel kernel, size_t local)
+{
+	cl_int error;
+	cl_uint bits;
+	size_t p2;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("CLArrayList: could not discover device address space\n");
+		return 0;
+	}
+
+	if(local == 0) {
+		error = clGetKernelWorkGroupInfo(kernel, dev,
+			CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &local, NULL);
+		if(error) {
+			printf("CLArrayList: could not discover work-group size\n");
+			return 0;
+		}
+	}
+
+	for(p2 = 1; p2 < local; p2 <<= 1);
+
+	return CLARRAYLIST_SCRATCH(p2) * (bits / 8);
+}
+
+/**
+ * clArrayList_reduce_create() - Set up an arraylist for clArrayList_grow_global
+ * @al: ArrayList
+ * @groups: Number of work-groups in the launch
+ * @return Scratch buffer, release after the launch. Create a fresh one for
+ * every launch calling clArrayList_grow_global.
+ */
+cl_mem
+clArrayList_reduce_create(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem al, cl_uint groups)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_kernel kernel;
+	size_t threads = 64;
+	cl_mem mem;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("CLArrayList: could not discover device address space\n");
+		return (cl_mem) 0;
+	}
+
+	mem = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+		(CLARRAYLIST_REDUCE_STATUS + groups) * (bits / 8), NULL, &error);
+	if(error) {
+		printf("CLArrayList: Could not allocate reduce memory on-device");
+		return (cl_mem) 0;
+	}
+
+	kernel = clCreateKernel(prg, "clArrayList_reduce_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: Could not create reduce init kernel: %i\n", error);
+		return (cl_mem) 0;
+	}
+
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &mem);
+	clSetKernelArg(kernel, 2, sizeof(cl_uint), &groups);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clArrayList: Could not execute reduce init kernel: %i\n", error);
+		return (cl_mem) 0;
+	}
+	error = clFinish(cq);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: failed to initialise reduce memory: %i\n", error);
+		return (cl_mem) 0;
+	}
+	clReleaseKernel(kernel);
+
+	return mem;
+}
+
+/**
+ * clArrayList_flatten() - Copy all objects into one contiguous buffer
+ * @al: ArrayList
+ * @count: Return value for the number of objects
+ * @return Buffer holding *count objects, NULL on error or if empty
+ */
+cl_mem
+clArrayList_flatten(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem al, size_t *count)
+{
+	cl_int error;
+	cl_uint bits, pagecount;
+	cl_kernel kernel;
+	size_t local, threads, objsize, total;
+	uint64_t words = 0;
+	union {
+		clArrayList_32 l32;
+		clArrayList_64 l64;
+	} host;
+	cl_mem pages, offsets, dst;
+
+	*count = 0;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("CLArrayList: could not discover device address space\n");
+		return (cl_mem) 0;
+	}
+
+	/* Page count and object size from the list header */
+	error = clEnqueueReadBuffer(cq, al, CL_TRUE, 0, (bits == 32) ?
+			sizeof(clArrayList_32) : sizeof(clArrayList_64), &host,
+			0, NULL, NULL);
+	if(error != CL_SUCCESS) {
+		printf("CLArrayList: Could not read arraylist: %i\n", error);
+		return (cl_mem) 0;
+	}
+
+	if(bits == 32) {
+		objsize = host.l32.objSize;
+		pagecount = host.l32.alloc >> CLARRAYLIST_ALLOC_SHIFT_32;
+	} else {
+		objsize = host.l64.objSize;
+		pagecount = host.l64.alloc >> CLARRAYLIST_ALLOC_SHIFT_64;
+	}
+	if(pagecount == 0)
+		return (cl_mem) 0;
+
+	pages = clCreateBuffer(ctx, CL_MEM_READ_WRITE, pagecount * (bits / 8),
+			NULL, &error);
+	if(error) {
+		printf("CLArrayList: Could not allocate page table on-device");
+		return (cl_mem) 0;
+	}
+	offsets = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+			(pagecount + 1) * (bits / 8), NULL, &error);
+	if(error) {
+		printf("CLArrayList: Could not allocate offsets on-device");
+		clReleaseMemObject(pages);
+		return (cl_mem) 0;
+	}
+
+	/* Page table and offsets, a single work-group */
+	kernel = clCreateKernel(prg, "clArrayList_flatten_index", &error);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: Could not create flatten index kernel: %i\n", error);
+		clReleaseMemObject(pages);
+		clReleaseMemObject(offsets);
+		return (cl_mem) 0;
+	}
+
+	error = clGetKernelWorkGroupInfo(kernel, dev, CL_KERNEL_WORK_GROUP_SIZE,
+			sizeof(size_t), &local, NULL);
+	if(error) {
+		printf("CLArrayList: could not discover work-group size\n");
+		clReleaseKernel(kernel);
+		clReleaseMemObject(pages);
+		clReleaseMemObject(offsets);
+		return (cl_mem) 0;
+	}
+	if(local > 256)
+		local = 256;
+
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &pages);
+	clSetKernelArg(kernel, 2, sizeof(cl_mem), &offsets);
+	clSetKernelArg(kernel, 3, local * (bits / 8), NULL);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &local, &local, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clArrayList: Could not execute flatten index kernel: %i\n", error);
+		clReleaseKernel(kernel);
+		clReleaseMemObject(pages);
+		clReleaseMemObject(offsets);
+		return (cl_mem) 0;
+	}
+	clReleaseKernel(kernel);
+
+	/* Little endian, so the low word is right for 32-bit too */
+	error = clEnqueueReadBuffer(cq, offsets, CL_TRUE, pagecount * (bits / 8),
+			bits / 8, &words, 0, NULL, NULL);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: Could not read object count: %i\n", error);
+		clReleaseMemObject(pages);
+		clReleaseMemObject(offsets);
+		return (cl_mem) 0;
+	}
+	total = words;
+
+	dst = NULL;
+	if(total > 0) {
+		dst = clCreateBuffer(ctx, CL_MEM_READ_WRITE, total * objsize,
+				NULL, &error);
+		if(error) {
+			printf("CLArrayList: Could not allocate flat buffer on-device");
+			clReleaseMemObject(pages);
+			clReleaseMemObject(offsets);
+			return (cl_mem) 0;
+		}
+
+		/* Copy, a work-group per page */
+		kernel = clCreateKernel(prg, "clArrayList_flatten_copy", &error);
+		if(error != CL_SUCCESS) {
+			printf("clArrayList: Could not create flatten copy kernel: %i\n", error);
+			clReleaseMemObject(dst);
+			clReleaseMemObject(pages);
+			clReleaseMemObject(offsets);
+			return (cl_mem) 0;
+		}
+
+		local = 64;
+		threads = pagecount * local;
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &pages);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &offsets);
+		clSetKernelArg(kernel, 3, sizeof(cl_uint), &pagecount);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &dst);
+
+		error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, &local, 0, NULL, NULL);
+		if (error != CL_SUCCESS) {
+			printf("clArrayList: Could not execute flatten copy kernel: %i\n", error);
+			clReleaseKernel(kernel);
+			clReleaseMemObject(dst);
+			clReleaseMemObject(pages);
+			clReleaseMemObject(offsets);
+			return (cl_mem) 0;
+		}
+		error = clFinish(cq);
+		clReleaseKernel(kernel);
+		if(error != CL_SUCCESS) {
+			printf("clArrayList: failed to flatten: %i\n", error);
+			clReleaseMemObject(dst);
+			clReleaseMemObject(pages);
+			clReleaseMemObject(offsets);
+			return (cl_mem) 0;
+		}
+	}
+
+	clReleaseMemObject(pages);
+	clReleaseMemObject(offsets);
+
+	*count = total;
+	return dst;
+}
+
+/**
+ * clArrayList_clear_all() - Free all pages and reset the list
+ * @al: ArrayList, not in use by any running kernel
+ * @return 0 on success, OpenCL error otherwise
+ */
+int
+clArrayList_clear_all(cl_device_id dev, cl_command_queue cq, cl_program prg,
+		cl_mem al)
+{
+	cl_int error;
+	cl_kernel kernel;
+	size_t local;
+
+	kernel = clCreateKernel(prg, "clArrayList_reset", &error);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: Could not create reset kernel: %i\n", error);
+		return error;
+	}
+
+	error = clGetKernelWorkGroupInfo(kernel, dev, CL_KERNEL_WORK_GROUP_SIZE,
+			sizeof(size_t), &local, NULL);
+	if(error) {
+		printf("CLArrayList: could not discover work-group size\n");
+		return error;
+	}
+
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
+	clSetKernelArg(kernel, 1, clArrayList_scratch_size(dev, kernel, local),
+			NULL);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &local, &local, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clArrayList: Could not execute reset kernel: %i\n", error);
+		return error;
+	}
+	error = clFinish(cq);
+	if(error != CL_SUCCESS) {
+		printf("clArrayList: failed to reset: %i\n", error);
+		return error;
+	}
+	clReleaseKernel(kernel);
+
+	return 0;
+}
@@ -24,25 +24,197 @@ __kernel void
 clArrayList_init(char __global *arrayList, unsigned int size, void __global *hp) {
 	struct clheap __global *heap = (struct clheap __global *)hp;
 	clArrayList __global *l = (clArrayList __global *)arrayList;
+	unsigned int i;
+
 	clQueue_init(&l->queue);
 	l->objSize = size;;
 	l->heap = heap;
+	l->alloc = 0;
+	l->cur = NULL;
+	for(i = 0; i < CLARRAYLIST_DIR_CHUNKS; i++)
+		l->dir[i] = NULL;
+}
+
+/**
+ * clArrayList_reduce_init() - Prepare reduce_mem for clArrayList_grow_global
+ * @arrayList: ArrayList
+ * @mem: Buffer of CLARRAYLIST_REDUCE_STATUS + groups pointers
+ * @groups: Number of work-groups in the launch to come
+ */
+__kernel void
+clArrayList_reduce_init(char __global *arrayList, uintptr_t __global *mem,
+		unsigned int groups)
+{
+	clArrayList __global *l = (clArrayList __global *)arrayList;
+	size_t pid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	if(pid == 0)
+		l->reduce_mem = mem;
+	for(i = pid; i < CLARRAYLIST_REDUCE_STATUS + groups; i += j)
+		mem[i] = 0;
+}
+
+/**
+ * _clArrayList_dirent() - Return the directory entry for page d
+ * @l: ArrayList
+ * @d: Page number, in allocation order
+ * @return The entry, NULL if its chunk doesn't exist
+ */
+struct clArrayList_dirent __global *
+_clArrayList_dirent(clArrayList __global *l, size_t d)
+{
+	struct clArrayList_dirent __global *chunk;
+
+	if((d >> CLARRAYLIST_DIR_CHUNK_L2) >= CLARRAYLIST_DIR_CHUNKS)
+		return NULL;
+
+	chunk = (struct clArrayList_dirent __global *)
+			l->dir[d >> CLARRAYLIST_DIR_CHUNK_L2];
+	if(chunk == NULL)
+		return NULL;
+
+	return &chunk[d & ((1 << CLARRAYLIST_DIR_CHUNK_L2) - 1)];
+}
+
+/**
+ * _clArrayList_dir_add() - Record page d in the directory
+ * @l: ArrayList
+ * @d: Page number, in allocation order
+ * @p: Page
+ *
+ * Chunks are allocated on first use. Whoever loses the race for a chunk
+ * gives its copy back. If no chunk can be had, the page is only reachable
+ * through the queue.
+ */
+void
+_clArrayList_dir_add(clArrayList __global *l, size_t d,
+		struct clArrayList_page __global *p)
+{
+	struct clArrayList_dirent __global *e;
+	uintptr_t chunk, old;
+	unsigned int c, i;
+
+	c = d >> CLARRAYLIST_DIR_CHUNK_L2;
+	if(c >= CLARRAYLIST_DIR_CHUNKS)
+		return;
+
+	if(l->dir[c] == NULL) {
+		chunk = (uintptr_t) malloc(l->heap,
+			sizeof(struct clArrayList_dirent) << CLARRAYLIST_DIR_CHUNK_L2);
+		if(chunk == NULL)
+			return;
+
+		e = (struct clArrayList_dirent __global *) chunk;
+		for(i = 0; i < (1 << CLARRAYLIST_DIR_CHUNK_L2); i++)
+			e[i].page = NULL;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		old = atom_cmpxchg(&l->dir[c], NULL, chunk);
+		if(old != NULL)
+			free(l->heap, chunk);
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	}
+
+	/* Page last, readers use it as the valid bit */
+	e = _clArrayList_dirent(l, d);
+	e->start = p->start;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	e->page = p;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+}
+
+/**
+ * _clArrayList_claim() - Claim objs slots in page p
+ * @l: ArrayList
+ * @p: Page
+ * @objs: Number of objects
+ * @return Pointer to the first slot, NULL if p is full
+ *
+ * Whoever straddles the end of the page shrinks count to what was handed
+ * out before it, so min(count, taken) is the number of valid objects.
+ */
+uintptr_t
+_clArrayList_claim(clArrayList __global *l,
+		struct clArrayList_page __global *p, unsigned int objs)
+{
+	size_t old;
+	char __global *pc;
+
+	old = atom_add(&p->taken, objs);
+	if(old + objs > p->count) {
+		if(old < p->count)
+			p->count = old;
+		return NULL;
+	}
+
+	pc = (char __global *) p;
+	pc += sizeof(struct clArrayList_page);
+	pc += old * l->objSize;
+
+	return (uintptr_t) pc;
 }
 
 uintptr_t
 clArrayList_grow(clArrayList __global *l, unsigned int objs) {
-	struct clArrayList_page __global *p;
-	size_t size;
+	struct clArrayList_page __global *p, *cur;
+	size_t size, cap;
+	uintptr_t alloc, ret;
 	char __global *pc;
 
-	size = (objs * l->objSize) + sizeof(struct clArrayList_page);
+	/* Fast path: room left in the current page */
+	cur = (struct clArrayList_page __global *) l->cur;
+	if(cur != NULL) {
+		ret = _clArrayList_claim(l, cur, objs);
+		if(ret != NULL)
+			return ret;
+	}
+
+	/* Full, grow geometrically up to CLARRAYLIST_PAGE_MAX */
+	cap = cur ? cur->count << 1 : max(objs, (unsigned int) CLARRAYLIST_PAGE_MIN);
+	if(cap * l->objSize + sizeof(struct clArrayList_page) > CLARRAYLIST_PAGE_MAX)
+		cap = (CLARRAYLIST_PAGE_MAX - sizeof(struct clArrayList_page)) /
+				l->objSize;
+	if(cap < objs)
+		cap = objs;
+
+	size = (cap * l->objSize) + sizeof(struct clArrayList_page);
 	p = (struct clArrayList_page __global *) malloc(l->heap, size);
+	if(p == NULL && cap > objs) {
+		cap = objs;
+		size = (cap * l->objSize) + sizeof(struct clArrayList_page);
+		p = (struct clArrayList_page __global *) malloc(l->heap, size);
+	}
 	if(p == NULL)
 		return NULL;
-	p->count = objs;
+
+	/* One atomic for both the directory slot and the start index. Refuse
+	 * rather than carry into the page count or wrap it. */
+	do {
+		alloc = l->alloc;
+		if(CLARRAYLIST_ALLOC_PAGES(alloc) >= CLARRAYLIST_ALLOC_PAGES_MAX ||
+		   CLARRAYLIST_ALLOC_OBJS(alloc) + cap > CLARRAYLIST_ALLOC_OBJS_MAX) {
+			free(l->heap, (uintptr_t) p);
+			return NULL;
+		}
+	} while(atom_cmpxchg(&l->alloc, alloc, alloc +
+			(((uintptr_t) 1 << CLARRAYLIST_ALLOC_SHIFT) | cap)) != alloc);
+	p->count = cap;
 	p->taken = objs;
+	p->start = CLARRAYLIST_ALLOC_OBJS(alloc);
 
 	enqueue(&l->queue, &p->next);
+	_clArrayList_dir_add(l, CLARRAYLIST_ALLOC_PAGES(alloc), p);
+
+	/* Whoever replaces the current page first wins, the loser's page just
+	 * doesn't get any more tenants */
+	if(cap > objs)
+		atom_cmpxchg(&l->cur, (uintptr_t) cur, (uintptr_t) p);
 
 	pc = (char __global *) p;
 	pc += sizeof(struct clArrayList_page);
@@ -50,48 +222,164 @@ clArrayList_grow(clArrayList __global *l, unsigned int objs) {
 	return (uintptr_t) pc;
 }
 
-//uintptr_t
-//clArrayList_grow_global(clArrayList __global *l, unsigned int objs) {
-//	const unsigned int pid = get_global_id(0);
-//	int that;
-//	unsigned int p = 1, off;
-//
-//	l->reduce_mem[pid] = objs * l->objSize;
-//	barrier(CLK_GLOBAL_MEM_FENCE);
-//
-//	/* Prefix-sum bluff me through this */
-//	/* Up-sweep */
-//	do {
-//		off = p;
-//		p <<= 1;
-//		if(pid % p == p - 1) {
-//			l->reduce_mem[pid] += l->reduce_mem[pid - off];
-//		}
-//		barrier(CLK_GLOBAL_MEM_FENCE);
-//	} while (p < get_global_size(0));
-//
-//	if(pid == get_global_size(0)-1) {
-//		/* In XMalloc, you'd want to allocate with this value! */
-//		l->reduce_mem[pid] = clArrayList_grow(l, l->reduce_mem[pid] / l->objSize);
-//	}
-//
-//	/* Down-sweep */
-//	do{
-//		barrier(CLK_GLOBAL_MEM_FENCE);
-//		off = p >> 1;
-//		if(pid % p == p - 1) {
-//			that = l->reduce_mem[pid - off];
-//			l->reduce_mem[pid - off] = l->reduce_mem[pid];
-//			l->reduce_mem[pid] += that;
-//		}
-//		p = off;
-//	} while (p > 1);
-//
-//	if(objs > 0)
-//		return l->reduce_mem[pid];
-//	else
-//		return NULL;
-//}
+/**
+ * _clArrayList_free_chain() - Free pages linked through their queue item
+ * @l: ArrayList
+ * @p: First page, the chain ends at a NULL next
+ */
+void
+_clArrayList_free_chain(clArrayList __global *l,
+		struct clArrayList_page __global *p)
+{
+	struct clArrayList_page __global *next;
+
+	while(p != NULL) {
+		next = (struct clArrayList_page __global *) p->next.next;
+		free(l->heap, (uintptr_t) p);
+		p = next;
+	}
+}
+
+/**
+ * _clArrayList_grow_region() - Allocate objs objects with consecutive indices
+ * @l: ArrayList
+ * @objs: Number of objects
+ * @start: Output, index of the first object
+ * @return Pointer to the first object, NULL on failure
+ *
+ * A single page if the heap hands out a block that large, otherwise a run of
+ * CLARRAYLIST_PAGE_MAX pages. All pages exist before the indices are
+ * reserved, so nobody else's pages end up in between.
+ */
+uintptr_t
+_clArrayList_grow_region(clArrayList __global *l, size_t objs, size_t *start)
+{
+	struct clArrayList_page __global *first, *last, *p;
+	size_t cap, left, idx, n, k;
+	uintptr_t alloc;
+	char __global *pc;
+
+	if(objs == 0)
+		return NULL;
+
+	cap = objs;
+	first = (struct clArrayList_page __global *) malloc(l->heap,
+			(cap * l->objSize) + sizeof(struct clArrayList_page));
+	if(first == NULL)
+		cap = (CLARRAYLIST_PAGE_MAX - sizeof(struct clArrayList_page)) /
+				l->objSize;
+	if(cap == 0)
+		return NULL;
+
+	/* Chain the pages through their queue item, to enqueue at once */
+	last = first;
+	for(left = objs, n = 0; left > 0; left -= p->count, n++) {
+		if(n == 0 && first != NULL) {
+			p = first;
+		} else {
+			p = (struct clArrayList_page __global *) malloc(l->heap,
+				(min(left, cap) * l->objSize) +
+				sizeof(struct clArrayList_page));
+			if(p == NULL) {
+				_clArrayList_free_chain(l, first);
+				return NULL;
+			}
+			if(first == NULL)
+				first = p;
+			else
+				last->next.next = (uintptr_t) p;
+			last = p;
+		}
+		p->next.next = NULL;
+		p->count = min(left, cap);
+		p->taken = p->count;
+	}
+
+	do {
+		alloc = l->alloc;
+		if(CLARRAYLIST_ALLOC_PAGES(alloc) + n > CLARRAYLIST_ALLOC_PAGES_MAX ||
+		   CLARRAYLIST_ALLOC_OBJS(alloc) + objs > CLARRAYLIST_ALLOC_OBJS_MAX) {
+			_clArrayList_free_chain(l, first);
+			return NULL;
+		}
+	} while(atom_cmpxchg(&l->alloc, alloc, alloc +
+			(((uintptr_t) n << CLARRAYLIST_ALLOC_SHIFT) | objs)) != alloc);
+
+	for(p = first, k = 0, idx = CLARRAYLIST_ALLOC_OBJS(alloc); k < n;
+	    k++, idx += p->count,
+	    p = (struct clArrayList_page __global *) p->next.next)
+		p->start = idx;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	/* enqueue_chain() clears last's next, the rest of the links stay */
+	enqueue_chain(&l->queue, &first->next, &last->next);
+	for(p = first, k = 0; k < n; k++,
+	    p = (struct clArrayList_page __global *) p->next.next)
+		_clArrayList_dir_add(l, CLARRAYLIST_ALLOC_PAGES(alloc) + k, p);
+
+	*start = CLARRAYLIST_ALLOC_OBJS(alloc);
+	pc = (char __global *) first;
+	pc += sizeof(struct clArrayList_page);
+
+	return (uintptr_t) pc;
+}
+
+/**
+ * _clArrayList_lookback() - Decoupled look-back over the work-groups
+ * @l: ArrayList, reduce_mem set up by clArrayList_reduce_init
+ * @bytes: Aggregate of this work-group
+ * @return Exclusive prefix of this work-group, in bytes
+ *
+ * Work-groups take a ticket once their aggregate is known, so everyone we
+ * wait for is past its local scan. Status words hold the value shifted left
+ * by two, with CLARRAYLIST_REDUCE_* in the low bits. The last ticket
+ * allocates the region for the whole NDRange.
+ */
+uintptr_t
+_clArrayList_lookback(clArrayList __global *l, uintptr_t bytes)
+{
+	uintptr_t __global *rm = l->reduce_mem;
+	volatile uintptr_t __global *status = &rm[CLARRAYLIST_REDUCE_STATUS];
+	uintptr_t excl = 0, st, ticket, groups, base;
+	size_t k, start = 0;
+	unsigned int i;
+
+	for(i = 0, groups = 1; i < get_work_dim(); i++)
+		groups *= get_num_groups(i);
+
+	ticket = atom_inc(&rm[CLARRAYLIST_REDUCE_TICKET]);
+
+	if(ticket > 0) {
+		status[ticket] = (bytes << 2) | CLARRAYLIST_REDUCE_AGGREGATE;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		k = ticket - 1;
+		loop_infinite(i) {
+			st = status[k];
+			if((st & 3) == CLARRAYLIST_REDUCE_INVALID)
+				continue;
+
+			excl += st >> 2;
+			if((st & 3) == CLARRAYLIST_REDUCE_PREFIX || k == 0)
+				break;
+			k--;
+		}
+	}
+
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	status[ticket] = ((excl + bytes) << 2) | CLARRAYLIST_REDUCE_PREFIX;
+
+	if(ticket == groups - 1) {
+		base = _clArrayList_grow_region(l, (excl + bytes) / l->objSize,
+				&start);
+		rm[CLARRAYLIST_REDUCE_START] = start;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		rm[CLARRAYLIST_REDUCE_BASE] = base;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	}
+
+	return excl;
+}
 
 unsigned int
 next_pow2(unsigned int value)
@@ -108,13 +396,64 @@ next_pow2(unsigned int value)
 	return (1 << i);
 }
 
+#ifdef CLARRAYLIST_SUBGROUPS
+/* Scan within each sub-group, then let sub-group 0 scan the per-sub-group
+ * totals. Two barriers regardless of work-group size. */
 uintptr_t
-clArrayList_grow_local(clArrayList __global *l, unsigned int objs,
-		uintptr_t __local *rMem) {
+_clArrayList_grow_collective(clArrayList __global *l, unsigned int objs,
+		uintptr_t __local *rMem, bool device_wide) {
+	uintptr_t bytes, prefix, v, s, carry;
+	unsigned int sg, sgs, lsg, nsg, k;
+
+	sg = get_sub_group_id();
+	nsg = get_num_sub_groups();
+	sgs = get_sub_group_size();
+	lsg = get_sub_group_local_id();
+
+	bytes = objs * l->objSize;
+	prefix = sub_group_scan_exclusive_add(bytes);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if(lsg == sgs - 1)
+		rMem[sg] = prefix + bytes;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(sg == 0) {
+		carry = 0;
+		for(k = 0; k < nsg; k += sgs) {
+			v = (k + lsg < nsg) ? rMem[k + lsg] : 0;
+			s = sub_group_scan_exclusive_add(v);
+			if(k + lsg < nsg)
+				rMem[k + lsg] = carry + s;
+			carry += sub_group_reduce_add(v);
+		}
+
+		/* Allocate */
+		if(lsg == 0) {
+			if(device_wide)
+				rMem[nsg] = _clArrayList_lookback(l, carry);
+			else
+				rMem[nsg] = clArrayList_grow(l, carry / l->objSize);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(device_wide)
+		return rMem[nsg] + rMem[sg] + prefix;
+
+	if(rMem[nsg] == 0 || objs == 0)
+		return NULL;
+
+	return rMem[nsg] + rMem[sg] + prefix;
+}
+#else
+uintptr_t
+_clArrayList_grow_collective(clArrayList __global *l, unsigned int objs,
+		uintptr_t __local *rMem, bool device_wide) {
 	size_t lid = 0, j;
-	unsigned int i, total;
+	unsigned int i, n, total;
 	unsigned int p = 1, off = 0, base;
-	int that;
+	uintptr_t that;
 
 	/* Find my id normalised from 3 to 1 dimension */
 	for(i = 0, j = 1; i < get_work_dim(); i++) {
@@ -125,11 +464,12 @@ clArrayList_grow_local(clArrayList __global *l, unsigned int objs,
 	barrier(CLK_LOCAL_MEM_FENCE);
 	/* set my desired objects */
 	rMem[lid] = objs * l->objSize;
-	/* Pad to the next power of 2... and some */
-	if((lid + j) < 128)
-		rMem[lid + j] = 0;
+	/* Pad to the next power of 2 */
+	n = next_pow2(j);
+	for(i = lid + j; i < n; i += j)
+		rMem[i] = 0;
 
-	i = next_pow2(j);
+	i = n;
 
 	/* Up-sweep - right threads omitted */
 	while (i > 1) {
@@ -146,11 +486,15 @@ clArrayList_grow_local(clArrayList __global *l, unsigned int objs,
 	/* Allocate */
 	barrier(CLK_LOCAL_MEM_FENCE);
 	if(lid == 0) {
-		total = rMem[p - 1] / l->objSize;
-		rMem[p - 1] = clArrayList_grow(l, total);
+		if(device_wide) {
+			rMem[p - 1] = _clArrayList_lookback(l, rMem[p - 1]);
+		} else {
+			total = rMem[p - 1] / l->objSize;
+			rMem[p - 1] = clArrayList_grow(l, total);
+		}
 	}
 	barrier(CLK_LOCAL_MEM_FENCE);
-	if(rMem[p - 1] == 0)
+	if(!device_wide && rMem[p - 1] == 0)
 		return NULL;
 
 	i = 1;
@@ -169,44 +513,327 @@ clArrayList_grow_local(clArrayList __global *l, unsigned int objs,
 		barrier(CLK_LOCAL_MEM_FENCE);
 	}
 
-	if(objs > 0)
+	if(objs > 0 || device_wide)
 		return rMem[lid];
 	else
 		return NULL;
 }
+#endif
+
+/**
+ * clArrayList_grow_local() - Allocate objs objects for each work-item
+ * @l: ArrayList
+ * @objs: Number of objects this work-item wants
+ * @rMem: Scratch, clArrayList_scratch_size() bytes of local memory
+ * @return Pointer to the first object, NULL if objs is 0 or malloc failed
+ *
+ * All work-items in the work-group must call this. One page is allocated
+ * for the whole work-group.
+ */
+uintptr_t
+clArrayList_grow_local(clArrayList __global *l, unsigned int objs,
+		uintptr_t __local *rMem)
+{
+	return _clArrayList_grow_collective(l, objs, rMem, false);
+}
+
+/**
+ * clArrayList_grow_global() - Allocate objs objects for each work-item
+ * @l: ArrayList, reduce_mem set up by clArrayList_reduce_init
+ * @objs: Number of objects this work-item wants
+ * @rMem: Scratch, clArrayList_scratch_size() bytes of local memory
+ * @return Index of this work-item's first object in the region
+ *
+ * All work-items in the NDRange must call this, once per launch. The
+ * region's objects have consecutive clArrayList_get() indices. It only
+ * exists once the last work-group has been through, see
+ * clArrayList_grow_global_get().
+ */
+size_t
+clArrayList_grow_global(clArrayList __global *l, unsigned int objs,
+		uintptr_t __local *rMem)
+{
+	return _clArrayList_grow_collective(l, objs, rMem, true) / l->objSize;
+}
 
+/**
+ * clArrayList_grow_global_base() - Region allocated by clArrayList_grow_global
+ * @l: ArrayList
+ * @return Pointer to the first object, NULL if not (yet) allocated
+ *
+ * Safe to use from a later kernel. Within the same launch this is only
+ * non-NULL once the last work-group is done; spinning on it requires all
+ * work-groups to be resident. The region is only contiguous from here if
+ * the heap could hand it out as one page, use clArrayList_grow_global_get()
+ * to index it.
+ */
 uintptr_t
-clArrayList_get(clArrayList __global *l, size_t i) {
-	size_t cml = 0;
+clArrayList_grow_global_base(clArrayList __global *l)
+{
+	volatile uintptr_t __global *rm = l->reduce_mem;
 
-	bool found = false;
-	uintptr_t ret;
-	char __global *cRet = NULL;
+	return rm[CLARRAYLIST_REDUCE_BASE];
+}
+
+/**
+ * clArrayList_grow_global_get() - Object i of the clArrayList_grow_global region
+ * @l: ArrayList
+ * @i: Index as returned by clArrayList_grow_global(), plus offset
+ * @return Pointer to the object, NULL if the region doesn't exist
+ *
+ * Same rules as clArrayList_grow_global_base(). Objects in the first page
+ * are found directly, the rest through clArrayList_get().
+ */
+uintptr_t
+clArrayList_grow_global_get(clArrayList __global *l, size_t i)
+{
+	volatile uintptr_t __global *rm = l->reduce_mem;
+	struct clArrayList_page __global *p;
+	uintptr_t base = rm[CLARRAYLIST_REDUCE_BASE];
+
+	if(base == NULL)
+		return NULL;
+
+	p = (struct clArrayList_page __global *)
+			(base - sizeof(struct clArrayList_page));
+	if(i < p->count)
+		return base + (i * l->objSize);
+
+	return clArrayList_get(l, rm[CLARRAYLIST_REDUCE_START] + i);
+}
+
+/**
+ * _clArrayList_get_walk() - Find object i by walking the page queue
+ * @l: ArrayList
+ * @i: Object index
+ * Fallback for pages that didn't make it into the directory.
+ */
+uintptr_t
+_clArrayList_get_walk(clArrayList __global *l, size_t i) {
+	char __global *cRet;
 	struct clArrayList_page __global *p = (struct clArrayList_page __global *) l->queue.head;
 
-	while(!found && p != NULL) {
-		if(cml + p->count > i) {
+	while(p != NULL) {
+		if(p->start <= i && i < p->start + CLARRAYLIST_PAGE_VALID(p)) {
 			cRet = (char __global *) p;
 			cRet += sizeof(struct clArrayList_page);
-			cRet += l->objSize * (i - cml);
-			ret = (uintptr_t) cRet;
-			found = true;
-		} else {
-			cml += p->count;
-			p = (struct clArrayList_page __global *) p->next.next;
+			cRet += l->objSize * (i - p->start);
+			return (uintptr_t) cRet;
 		}
+		p = (struct clArrayList_page __global *) p->next.next;
+	}
+	return NULL;
+}
+
+/**
+ * clArrayList_get() - Return a pointer to object i
+ * @l: ArrayList
+ * @i: Object index, objects are numbered in order of allocation
+ *
+ * Indices are handed out per page capacity, so an index in the unused tail
+ * of a page returns NULL. Binary search over the page directory, each step costing a load of the
+ * chunk pointer and one of the entry.
+ */
+uintptr_t
+clArrayList_get(clArrayList __global *l, size_t i) {
+	struct clArrayList_dirent __global *e;
+	struct clArrayList_page __global *p;
+	uintptr_t alloc = l->alloc;
+	size_t lo = 0, hi, mid;
+	char __global *cRet;
+
+	if(i >= CLARRAYLIST_ALLOC_OBJS(alloc))
+		return NULL;
+
+	hi = CLARRAYLIST_ALLOC_PAGES(alloc);
+	while(hi - lo > 1) {
+		mid = (lo + hi) >> 1;
+		e = _clArrayList_dirent(l, mid);
+		if(e == NULL || e->page == NULL)
+			return _clArrayList_get_walk(l, i);
+
+		if(e->start <= i)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	e = _clArrayList_dirent(l, lo);
+	if(e == NULL || e->page == NULL)
+		return _clArrayList_get_walk(l, i);
+
+	p = e->page;
+	if(i - e->start >= CLARRAYLIST_PAGE_VALID(p))
+		return NULL;
+
+	cRet = (char __global *) p;
+	cRet += sizeof(struct clArrayList_page);
+	cRet += l->objSize * (i - e->start);
+	return (uintptr_t) cRet;
+}
+
+/**
+ * clArrayList_flatten_index() - Page table and offsets for flattening
+ * @arrayList: ArrayList
+ * @pages: Output, a pointer per page
+ * @offsets: Output, first object of each page in the flat buffer, followed
+ *           by the total number of objects
+ * @rMem: Scratch, one entry per work-item
+ *
+ * Run as a single work-group. Pages are taken from the directory, so the
+ * flat buffer is in clArrayList_get() order. If the directory is incomplete
+ * the queue is walked instead, in which case pages end up in queue order.
+ * Entries the queue has no page for are NULL and hold no objects.
+ */
+__kernel void
+clArrayList_flatten_index(char __global *arrayList,
+		uintptr_t __global *pages, size_t __global *offsets,
+		uintptr_t __local *rMem)
+{
+	clArrayList __global *l = (clArrayList __global *)arrayList;
+	struct clArrayList_dirent __global *e;
+	struct clArrayList_page __global *p;
+	__local unsigned int missing;
+	size_t lid = 0, lsize, n, d, first, last, sum;
+	unsigned int i;
+
+	for(i = 0, lsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+
+	n = CLARRAYLIST_ALLOC_PAGES(l->alloc);
+	if(lid == 0)
+		missing = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(d = lid; d < n; d += lsize) {
+		e = _clArrayList_dirent(l, d);
+		if(e == NULL || e->page == NULL) {
+			missing = 1;
+			break;
+		}
+		pages[d] = (uintptr_t) e->page;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(missing) {
+		if(lid == 0) {
+			p = (struct clArrayList_page __global *) l->queue.head;
+			for(d = 0; d < n && p != NULL; d++) {
+				pages[d] = (uintptr_t) p;
+				p = (struct clArrayList_page __global *) p->next.next;
+			}
+			for(; d < n; d++)
+				pages[d] = NULL;
+		}
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	}
+
+	/* Each work-item scans a contiguous block of pages. Block sums are
+	 * scanned by work-item 0. */
+	first = (n * lid) / lsize;
+	last = (n * (lid + 1)) / lsize;
+	for(d = first, sum = 0; d < last; d++) {
+		p = (struct clArrayList_page __global *) pages[d];
+		if(p != NULL)
+			sum += CLARRAYLIST_PAGE_VALID(p);
+	}
+	rMem[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(lid == 0) {
+		for(d = 0, sum = 0; d < lsize; d++) {
+			first = rMem[d];
+			rMem[d] = sum;
+			sum += first;
+		}
+		offsets[n] = sum;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	first = (n * lid) / lsize;
+	for(d = first, sum = rMem[lid]; d < last; d++) {
+		p = (struct clArrayList_page __global *) pages[d];
+		offsets[d] = sum;
+		if(p != NULL)
+			sum += CLARRAYLIST_PAGE_VALID(p);
+	}
+}
+
+/**
+ * clArrayList_flatten_copy() - Copy pages into the flat buffer
+ * @arrayList: ArrayList
+ * @pages: Page table from clArrayList_flatten_index
+ * @offsets: Offsets from clArrayList_flatten_index
+ * @pagecount: Number of pages
+ * @dst: Flat buffer, offsets[pagecount] objects
+ *
+ * One work-group per page. Objects that are a multiple of 4 bytes are
+ * copied in uint4 vectors.
+ */
+__kernel void
+clArrayList_flatten_copy(char __global *arrayList, uintptr_t __global *pages,
+		size_t __global *offsets, unsigned int pagecount,
+		char __global *dst)
+{
+	clArrayList __global *l = (clArrayList __global *)arrayList;
+	struct clArrayList_page __global *p;
+	char __global *src, *out;
+	size_t lid = 0, lsize, gid = 0, gsize, bytes, k;
+	unsigned int i;
+
+	for(i = 0, lsize = 1, gsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+		gid += gsize * get_group_id(i);
+		gsize *= get_num_groups(i);
+	}
+
+	for(; gid < pagecount; gid += gsize) {
+		p = (struct clArrayList_page __global *) pages[gid];
+		if(p == NULL)
+			continue;
+
+		src = (char __global *) p;
+		src += sizeof(struct clArrayList_page);
+		out = &dst[offsets[gid] * l->objSize];
+		bytes = (offsets[gid + 1] - offsets[gid]) * l->objSize;
+
+		if(l->objSize & 3) {
+			for(k = lid; k < bytes; k += lsize)
+				out[k] = src[k];
+			continue;
+		}
+
+		bytes >>= 2;
+		for(k = lid; k < (bytes >> 2); k += lsize)
+			vstore4(vload4(k, (uint __global *) src), k,
+					(uint __global *) out);
+		for(k = (bytes & ~3) + lid; k < bytes; k += lsize)
+			((uint __global *) out)[k] = ((uint __global *) src)[k];
 	}
-	return ret;
 }
 
 /*
  * One by one dequeue all the elements and free them. Should be safe to call
  * in parallel, as long as nobody is actually going to use the ArrayList.
+ * Resets the allocation counter and frees the directory chunks, leaving the
+ * list as clArrayList_clear_local does.
  */
 void
 clArrayList_clear(clArrayList __global *l)
 {
 	uintptr_t p;
+	unsigned int i;
+
+	l->cur = NULL;
+	atom_xchg(&l->alloc, 0);
+	for(i = 0; i < CLARRAYLIST_DIR_CHUNKS; i++) {
+		p = atom_xchg(&l->dir[i], NULL);
+		if(p != NULL)
+			free(l->heap, p);
+	}
 
 	p = (uintptr_t) dequeue(&l->queue);
 	while(p != NULL) {
@@ -215,6 +842,178 @@ clArrayList_clear(clArrayList __global *l)
 	}
 }
 
+/* Per-object function for clArrayList_map. Override with
+ * -DCLARRAYLIST_MAP_FN=name and define
+ * void name(clArrayList __global *l, uintptr_t obj, size_t i, uintptr_t arg)
+ * in any of the program sources. */
+#ifndef CLARRAYLIST_MAP_FN
+#define CLARRAYLIST_MAP_FN clArrayList_test_map
+#define CLARRAYLIST_MAP_TEST
+#endif
+
+void CLARRAYLIST_MAP_FN(clArrayList __global *, uintptr_t, size_t, uintptr_t);
+
+/**
+ * _clArrayList_map_page() - Apply CLARRAYLIST_MAP_FN to a page's objects
+ * @l: ArrayList
+ * @p: Page
+ * @lid: Work-item id within the work-group
+ * @lsize: Work-group size
+ * @arg: Passed on to CLARRAYLIST_MAP_FN
+ */
+void
+_clArrayList_map_page(clArrayList __global *l,
+		struct clArrayList_page __global *p, size_t lid, size_t lsize,
+		uintptr_t arg)
+{
+	char __global *data;
+	size_t k, valid;
+
+	data = (char __global *) p;
+	data += sizeof(struct clArrayList_page);
+	valid = CLARRAYLIST_PAGE_VALID(p);
+
+	for(k = lid; k < valid; k += lsize)
+		CLARRAYLIST_MAP_FN(l, (uintptr_t) &data[k * l->objSize],
+				p->start + k, arg);
+}
+
+/**
+ * clArrayList_map() - Apply CLARRAYLIST_MAP_FN to every object
+ * @l: ArrayList, not grown meanwhile
+ * @arg: Passed on to CLARRAYLIST_MAP_FN
+ *
+ * Work-groups take pages round-robin, work-items take neighbouring objects
+ * within a page. Pages come from the directory, or from the queue if the
+ * directory is incomplete.
+ */
+void
+clArrayList_map(clArrayList __global *l, uintptr_t arg)
+{
+	struct clArrayList_dirent __global *e;
+	struct clArrayList_page __global *p;
+	size_t lid = 0, lsize, gid = 0, gsize, n, d;
+	unsigned int i;
+	bool complete = true;
+
+	for(i = 0, lsize = 1, gsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+		gid += gsize * get_group_id(i);
+		gsize *= get_num_groups(i);
+	}
+
+	/* A page whose chunk couldn't be allocated at the time has no entry,
+	 * even if a later page created the chunk */
+	n = CLARRAYLIST_ALLOC_PAGES(l->alloc);
+	for(d = 0; complete && d < n; d++) {
+		e = _clArrayList_dirent(l, d);
+		complete = (e != NULL && e->page != NULL);
+	}
+
+	if(complete) {
+		for(d = gid; d < n; d += gsize)
+			_clArrayList_map_page(l, _clArrayList_dirent(l, d)->page,
+					lid, lsize, arg);
+		return;
+	}
+
+	p = (struct clArrayList_page __global *) l->queue.head;
+	for(d = 0; p != NULL; d++) {
+		if(d % gsize == gid)
+			_clArrayList_map_page(l, p, lid, lsize, arg);
+		p = (struct clArrayList_page __global *) p->next.next;
+	}
+}
+
+/**
+ * clArrayList_foreach() - Kernel wrapper for clArrayList_map
+ * @arrayList: ArrayList
+ * @arg: Passed on to CLARRAYLIST_MAP_FN
+ */
+__kernel void
+clArrayList_foreach(char __global *arrayList, void __global *arg)
+{
+	clArrayList_map((clArrayList __global *) arrayList, (uintptr_t) arg);
+}
+
+/**
+ * clArrayList_clear_local() - Free all pages, collectively
+ * @l: ArrayList
+ * @rMem: Scratch, clArrayList_scratch_size() bytes of local memory
+ *
+ * All work-items in the work-group must call this, and nobody else may use
+ * the list meanwhile. The chain is detached with one exchange, pages are
+ * freed in parallel through the directory. If the directory is incomplete
+ * the first work-item walks the chain instead.
+ */
+void
+clArrayList_clear_local(clArrayList __global *l, uintptr_t __local *rMem)
+{
+	struct clArrayList_dirent __global *e;
+	uintptr_t head, chunk, p, next;
+	size_t lid = 0, lsize, n, d;
+	unsigned int i;
+
+	for(i = 0, lsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	if(lid == 0) {
+		l->cur = NULL;
+		rMem[0] = atom_xchg(&l->queue.head, NULL);
+		atom_xchg(&l->queue.tail, NULL);
+		rMem[1] = CLARRAYLIST_ALLOC_PAGES(atom_xchg(&l->alloc, 0));
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+	head = rMem[0];
+	n = rMem[1];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	/* Directory complete? */
+	for(d = lid; d < n; d += lsize) {
+		e = _clArrayList_dirent(l, d);
+		if(e == NULL || e->page == NULL) {
+			rMem[1] = 0;
+			break;
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(rMem[1] == n) {
+		for(d = lid; d < n; d += lsize)
+			free(l->heap, (uintptr_t) _clArrayList_dirent(l, d)->page);
+	} else if(lid == 0) {
+		for(p = head; p != NULL; p = next) {
+			next = ((clqueue_item __global *) p)->next;
+			free(l->heap, p);
+		}
+	}
+	barrier(CLK_GLOBAL_MEM_FENCE);
+
+	/* Directory chunks last, the frees above read them */
+	for(d = lid; d < CLARRAYLIST_DIR_CHUNKS; d += lsize) {
+		chunk = l->dir[d];
+		l->dir[d] = NULL;
+		if(chunk != NULL)
+			free(l->heap, chunk);
+	}
+}
+
+/**
+ * clArrayList_reset() - Clear an ArrayList from the host
+ * @arrayList: ArrayList
+ * @rMem: Scratch, clArrayList_scratch_size() bytes of local memory
+ * Run as a single work-group.
+ */
+__kernel void
+clArrayList_reset(char __global *arrayList, uintptr_t __local *rMem)
+{
+	clArrayList_clear_local((clArrayList __global *) arrayList, rMem);
+}
+
 //__kernel void
 //clArrayList_test_top (char __global *arrayList, struct clheap __global *heap)
 //{
@@ -318,11 +1117,11 @@ clArrayList_clear(clArrayList __global *l)
 //}
 
 __kernel void
-clArrayList_test_justgrow(void __global *hp, char __global *arrayList)
+clArrayList_test_justgrow(void __global *hp, char __global *arrayList,
+		uintptr_t __local *rMem)
 {
 	struct clheap __global *heap = (struct clheap __global *)hp;
 	clArrayList __global *al = (clArrayList __global *) arrayList;
-	uintptr_t __local rMem[128]; /* Whoaverprovisioning!!! */
 	size_t pid = 0, j;
 	unsigned int i, amount;
 	unsigned int __global *ptr;
@@ -337,11 +1136,81 @@ clArrayList_test_justgrow(void __global *hp, char __global *arrayList)
 		amount = ((pid + i) % 2) ? 1 : 2;
 		ptr = (unsigned int __global *)
 				clArrayList_grow_local(al, amount, rMem);
-		if(ptr)
+		if(ptr) {
 			ptr[0] = pid;
+			if(amount > 1)
+				ptr[1] = pid;
+		}
+	}
+}
+
+__kernel void
+clArrayList_test_justgrow_global(void __global *hp, char __global *arrayList,
+		uintptr_t __local *rMem, size_t __global *idx)
+{
+	clArrayList __global *al = (clArrayList __global *) arrayList;
+	size_t pid = 0, j;
+	unsigned int i;
+
+	/* Project global ID to 1D */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	/* Same amount as ten rounds of clArrayList_test_justgrow */
+	idx[pid] = clArrayList_grow_global(al, 15, rMem);
+}
+
+/* Tag the objects clArrayList_test_justgrow_global handed to each work-item */
+__kernel void
+clArrayList_test_justgrow_global_fill(char __global *arrayList,
+		size_t __global *idx)
+{
+	clArrayList __global *al = (clArrayList __global *) arrayList;
+	size_t pid = 0, j;
+	unsigned int i;
+	unsigned int __global *ptr;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	for(i = 0; i < 15; i++) {
+		ptr = (unsigned int __global *)
+				clArrayList_grow_global_get(al, idx[pid] + i);
+		if(ptr)
+			*ptr = pid;
 	}
 }
 
+/* Grow one object at a time from a single work-item */
+__kernel void
+clArrayList_test_grow_serial(void __global *hp, char __global *arrayList,
+		unsigned int n)
+{
+	clArrayList __global *al = (clArrayList __global *) arrayList;
+	unsigned int i;
+
+	for(i = 0; i < n; i++)
+		clArrayList_grow(al, 1);
+}
+
+#ifdef CLARRAYLIST_MAP_TEST
+/* Count the objects, and check they are at their clArrayList_get() index */
+void
+clArrayList_test_map(clArrayList __global *l, uintptr_t obj, size_t i,
+		uintptr_t arg)
+{
+	unsigned int __global *cnt = (unsigned int __global *) arg;
+
+	atom_inc(&cnt[0]);
+	if(clArrayList_get(l, i) != obj)
+		atom_inc(&cnt[1]);
+}
+#endif
+
 __kernel void
 clArrayList_test_justgrow_malloc(void __global *hp)
 {
@@ -363,3 +1232,51 @@ clArrayList_test_justgrow_malloc(void __global *hp)
 			*ptr = pid;
 	}
 }
+
+__kernel void
+clArrayList_test_get_fill(void __global *hp, char __global *arrayList,
+		uintptr_t __local *rMem)
+{
+	clArrayList __global *al = (clArrayList __global *) arrayList;
+	unsigned int i;
+	unsigned int __global *ptr;
+
+	/* Tag every object with its own address */
+	for(i = 0; i < 10; i++) {
+		ptr = (unsigned int __global *)
+				clArrayList_grow_local(al, 1, rMem);
+		if(ptr)
+			ptr[0] = (unsigned int) (uintptr_t) ptr;
+	}
+}
+
+/* Read back objects of clArrayList_test_get_fill, whichever page they ended
+ * up in. cnt[0] counts the hits, cnt[1] the objects that don't hold their
+ * own tag. */
+__kernel void
+clArrayList_test_get(void __global *hp, char __global *arrayList,
+		unsigned int __global *cnt)
+{
+	clArrayList __global *al = (clArrayList __global *) arrayList;
+	size_t pid = 0, j, objs;
+	unsigned int i;
+	unsigned int __global *ptr;
+
+	/* Project global ID to 1D */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	objs = CLARRAYLIST_ALLOC_OBJS(al->alloc);
+	for(i = 0; i < 10 && objs > 0; i++) {
+		ptr = (unsigned int __global *)
+				clArrayList_get(al, (pid * 7 + i * j) % objs);
+		if(ptr == NULL)
+			continue;
+
+		atom_inc(&cnt[0]);
+		if(ptr[0] != (unsigned int) (uintptr_t) ptr)
+			atom_inc(&cnt[1]);
+	}
+}
@@ -23,6 +23,42 @@
 #include "clheap.h"
 #include "clQueue.h"
 
+#define CLARRAYLIST_DIR_CHUNK_L2 7	/**< Log 2 of entries per chunk */
+
+/* Page directory chunks. On 32-bit devices the directory covers every page
+ * the allocation counter can number. On 64-bit ones it covers the first
+ * 16384 pages, clArrayList_get() walks the queue for the rest. */
+#define CLARRAYLIST_DIR_CHUNKS_32 32
+#define CLARRAYLIST_DIR_CHUNKS_64 128
+
+/* Scratch entries clArrayList_grow_local needs for a work-group of n, where
+ * p2 is n rounded up to the next power of two */
+#define CLARRAYLIST_SCRATCH(p2) ((p2) + 1)
+
+/* Largest page grown to, in bytes including the header. Half a KMA
+ * superblock so pages don't waste a bucket. */
+#define CLARRAYLIST_PAGE_MAX 2048
+
+/* Objects in the first page, later pages double in capacity */
+#define CLARRAYLIST_PAGE_MIN 16
+
+/* Shift of the page count in the allocation counter, see clArrayList.alloc.
+ * The object part counts page capacity, not objects handed out: every page
+ * reserves its full capacity of indices up front. */
+#define CLARRAYLIST_ALLOC_SHIFT_32 20
+#define CLARRAYLIST_ALLOC_SHIFT_64 40
+
+/* Layout of reduce_mem for clArrayList_grow_global */
+#define CLARRAYLIST_REDUCE_TICKET 0	/**< Next work-group ticket */
+#define CLARRAYLIST_REDUCE_BASE 1	/**< Region handed out */
+#define CLARRAYLIST_REDUCE_START 2	/**< Index of the region's first object */
+#define CLARRAYLIST_REDUCE_STATUS 3	/**< First status word */
+
+/* Status word flags */
+#define CLARRAYLIST_REDUCE_INVALID 0
+#define CLARRAYLIST_REDUCE_AGGREGATE 1
+#define CLARRAYLIST_REDUCE_PREFIX 2
+
 #ifdef __OPENCL_CL_H
 #include <stdbool.h>
 
@@ -36,6 +72,9 @@ typedef struct {
 	clqueue_32 queue;
 	uint32_t heap;
 	uint32_t reduce_mem;
+	uint32_t alloc;
+	uint32_t cur;
+	uint32_t dir[CLARRAYLIST_DIR_CHUNKS_32];
 } clArrayList_32;
 
 typedef struct {
@@ -43,25 +82,82 @@ typedef struct {
 	clqueue_64 queue;
 	uint64_t heap;
 	uint64_t reduce_mem;
+	uint64_t alloc;
+	uint64_t cur;
+	uint64_t dir[CLARRAYLIST_DIR_CHUNKS_64];
 } clArrayList_64;
 
 extern cl_mem clArrayList_create(cl_device_id dev, cl_context ctx,
 	cl_command_queue cq, cl_program prg, cl_uint objsize, cl_mem heap);
+extern size_t clArrayList_scratch_size(cl_device_id dev, cl_kernel kernel,
+	size_t local);
+extern cl_mem clArrayList_reduce_create(cl_device_id dev, cl_context ctx,
+	cl_command_queue cq, cl_program prg, cl_mem al, cl_uint groups);
+extern int clArrayList_clear_all(cl_device_id dev, cl_command_queue cq,
+	cl_program prg, cl_mem al);
+extern cl_mem clArrayList_flatten(cl_device_id dev, cl_context ctx,
+	cl_command_queue cq, cl_program prg, cl_mem al, size_t *count);
 #else
+/* Sub-group scan for clArrayList_grow_local, Blelloch in local mem otherwise */
+#ifdef cl_khr_subgroups
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#define CLARRAYLIST_SUBGROUPS
+#endif
+
+/* The allocation counter packs the number of pages in the upper bits and the
+ * number of objects in the lower bits, so one update hands out both a
+ * directory slot and a start index in the same order. Neither field may
+ * overflow into the other, clArrayList_grow() fails once either is full. */
+#if CL_BITNESS == 64
+#define CLARRAYLIST_ALLOC_SHIFT CLARRAYLIST_ALLOC_SHIFT_64
+#define CLARRAYLIST_DIR_CHUNKS CLARRAYLIST_DIR_CHUNKS_64
+#else
+#define CLARRAYLIST_ALLOC_SHIFT CLARRAYLIST_ALLOC_SHIFT_32
+#define CLARRAYLIST_DIR_CHUNKS CLARRAYLIST_DIR_CHUNKS_32
+#endif
+#define CLARRAYLIST_ALLOC_OBJS(a) ((a) & (((uintptr_t) 1 << CLARRAYLIST_ALLOC_SHIFT) - 1))
+#define CLARRAYLIST_ALLOC_PAGES(a) ((a) >> CLARRAYLIST_ALLOC_SHIFT)
+#define CLARRAYLIST_ALLOC_OBJS_MAX (((uintptr_t) 1 << CLARRAYLIST_ALLOC_SHIFT) - 1)
+#define CLARRAYLIST_ALLOC_PAGES_MAX \
+	(((uintptr_t) 1 << (CL_BITNESS - CLARRAYLIST_ALLOC_SHIFT)) - 1)
+
 typedef struct {
 	size_t objSize;
 	clqueue queue;
 	struct clheap __global *heap;
-	uintptr_t __global *reduce_mem;
+	uintptr_t __global *reduce_mem;	/**< See CLARRAYLIST_REDUCE_* */
+	volatile uintptr_t alloc;	/**< Pages and object indices handed out */
+	volatile uintptr_t cur;		/**< Page to claim slots from */
+	volatile uintptr_t dir[CLARRAYLIST_DIR_CHUNKS]; /**< Page directory */
 } clArrayList;
 
 struct clArrayList_page {
 	clqueue_item next;
-	size_t count;
-	size_t taken;
+	volatile size_t count;		/**< Capacity */
+	volatile size_t taken;		/**< Slots claimed, may exceed count */
+	size_t start;			/**< Index of the first object */
 };
 
+/* Number of objects handed out from page p */
+#define CLARRAYLIST_PAGE_VALID(p) min((p)->count, (p)->taken)
+
+/* A directory chunk holds 1 << CLARRAYLIST_DIR_CHUNK_L2 of these, in
+ * allocation order and thus sorted by start */
+struct clArrayList_dirent {
+	volatile size_t start;
+	struct clArrayList_page __global * volatile page;
+};
+
+uintptr_t clArrayList_grow(clArrayList __global *, unsigned int);
 uintptr_t clArrayList_grow_local(clArrayList __global *, unsigned int,
 		uintptr_t __local *);
+size_t clArrayList_grow_global(clArrayList __global *, unsigned int,
+		uintptr_t __local *);
+uintptr_t clArrayList_grow_global_base(clArrayList __global *);
+uintptr_t clArrayList_grow_global_get(clArrayList __global *, size_t);
+uintptr_t clArrayList_get(clArrayList __global *, size_t);
+void clArrayList_clear(clArrayList __global *);
+void clArrayList_clear_local(clArrayList __global *, uintptr_t __local *);
+void clArrayList_map(clArrayList __global *, uintptr_t);
 #endif
 #endif
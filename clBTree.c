@@ -0,0 +1,70 @@
+/**
+ * clBTree.c
+ * Concurrent OpenCL B-link tree, C frontend
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clBTree.h"
+
+cl_mem
+clBTree_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem heap)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_mem t;
+	cl_kernel kernel;
+	size_t threads = 1;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("clBTree: could not discover device address space\n");
+		return NULL;
+	}
+
+	t = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (bits == 32) ?
+			sizeof(clBTree_32) : sizeof(clBTree_64), NULL, &error);
+	if(error) {
+		printf("clBTree: Could not allocate tree on-device\n");
+		return NULL;
+	}
+
+	/* Initialise kernel, allocates the root leaf */
+	kernel = clCreateKernel(prg, "clBTree_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("clBTree: Could not create tree init kernel: %i\n", error);
+		return NULL;
+	}
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &t);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &heap);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("clBTree: Could not execute tree init kernel: %i\n", error);
+		return NULL;
+	}
+	clReleaseKernel(kernel);
+
+	return t;
+}
@@ -0,0 +1,439 @@
+/**
+ * clBTree.cl
+ * Concurrent B-link tree implementation in OpenCL
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clBTree.h"
+
+/**
+ * _clBTree_node_new() - Allocate and initialise a node
+ * @t: Tree
+ * @level: Level of the node, 0 for a leaf
+ * @return The node, NULL if the heap is exhausted
+ */
+struct clBTree_node __global *
+_clBTree_node_new(clBTree __global *t, uint32_t level)
+{
+	struct clBTree_node __global *n;
+
+	n = (struct clBTree_node __global *)
+			malloc(t->heap, sizeof(struct clBTree_node));
+	if(n == NULL)
+		return NULL;
+
+	n->version = 0;
+	n->count = 0;
+	n->level = level;
+	n->high = CLBTREE_INF;
+	n->right = NULL;
+
+	return n;
+}
+
+__kernel void
+clBTree_init(void __global *tree, void __global *hp)
+{
+	clBTree __global *t = (clBTree __global *) tree;
+
+	t->heap = (struct clheap __global *) hp;
+	t->root = _clBTree_node_new(t, 0);
+}
+
+/**
+ * _clBTree_read_begin() - Wait for a node to be unlocked
+ * @n: Node
+ * @return Version to validate against
+ */
+uint32_t
+_clBTree_read_begin(struct clBTree_node __global *n)
+{
+	uint32_t v;
+	unsigned int i;
+
+	loop_infinite(i) {
+		v = n->version;
+		if(!(v & 1))
+			break;
+	}
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	return v;
+}
+
+/**
+ * _clBTree_read_valid() - Check nobody wrote a node since read_begin
+ * @n: Node
+ * @v: Version returned by _clBTree_read_begin
+ */
+bool
+_clBTree_read_valid(struct clBTree_node __global *n, uint32_t v)
+{
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	return n->version == v;
+}
+
+/**
+ * _clBTree_lock() - Lock a node
+ * @n: Node
+ * @return 1 iff locked. Fails only where loop_infinite is bounded.
+ */
+int
+_clBTree_lock(struct clBTree_node __global *n)
+{
+	uint32_t v;
+	unsigned int i;
+
+	loop_infinite(i) {
+		v = n->version;
+		if(v & 1)
+			continue;
+		if(atom_cmpxchg(&n->version, v, v + 1) == v) {
+			mem_fence(CLK_GLOBAL_MEM_FENCE);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void
+_clBTree_unlock(struct clBTree_node __global *n)
+{
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	atom_inc(&n->version);
+}
+
+/**
+ * _clBTree_child() - Index of the child of inner node n that covers key
+ */
+uint32_t
+_clBTree_child(struct clBTree_node __global *n, uint32_t key)
+{
+	uint32_t i;
+
+	for(i = n->count - 1; i > 0; i--) {
+		if(n->keys[i] <= key)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * _clBTree_find() - Find the node on a level that should hold key
+ * @t: Tree
+ * @key: Key
+ * @level: Level to stop at, 0 for a leaf
+ * @return The node, NULL if the tree isn't that high (yet). The node may
+ *         have split since, callers must check the high key once locked.
+ */
+struct clBTree_node __global *
+_clBTree_find(clBTree __global *t, uint32_t key, uint32_t level)
+{
+	struct clBTree_node __global *n, *next;
+	uint32_t v;
+
+	n = t->root;
+	if(n == NULL || n->level < level)
+		return NULL;
+
+	while(1) {
+		v = _clBTree_read_begin(n);
+		if(key >= n->high)
+			next = n->right;
+		else if(n->level == level)
+			next = NULL;
+		else
+			next = (struct clBTree_node __global *)
+					n->vals[_clBTree_child(n, key)];
+
+		if(!_clBTree_read_valid(n, v))
+			continue;
+		if(next == NULL)
+			return n;
+		n = next;
+	}
+}
+
+/**
+ * _clBTree_insert_at() - Insert into a locked node with room to spare
+ */
+void
+_clBTree_insert_at(struct clBTree_node __global *n, uint32_t key,
+		uintptr_t val)
+{
+	uint32_t i;
+
+	for(i = n->count; i > 0 && n->keys[i - 1] > key; i--) {
+		n->keys[i] = n->keys[i - 1];
+		n->vals[i] = n->vals[i - 1];
+	}
+	n->keys[i] = key;
+	n->vals[i] = val;
+	n->count++;
+}
+
+/**
+ * _clBTree_split() - Move the upper half of locked node n to a new node
+ * @return The new right sibling, NULL if the heap is exhausted
+ *
+ * The sibling is only reachable through n->right, which is set last.
+ */
+struct clBTree_node __global *
+_clBTree_split(clBTree __global *t, struct clBTree_node __global *n)
+{
+	struct clBTree_node __global *r;
+	uint32_t i, half = CLBTREE_KEYS >> 1;
+
+	r = _clBTree_node_new(t, n->level);
+	if(r == NULL)
+		return NULL;
+
+	for(i = half; i < CLBTREE_KEYS; i++) {
+		r->keys[i - half] = n->keys[i];
+		r->vals[i - half] = n->vals[i];
+	}
+	r->count = CLBTREE_KEYS - half;
+	r->high = n->high;
+	r->right = n->right;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	n->count = half;
+	n->right = r;
+	n->high = r->keys[0];
+
+	return r;
+}
+
+/**
+ * _clBTree_grow() - Put a new root on top of a root that just split
+ * @t: Tree
+ * @old: The old root
+ * @r: Its new right sibling
+ * @return 1 iff this installed the new root
+ */
+int
+_clBTree_grow(clBTree __global *t, struct clBTree_node __global *old,
+		struct clBTree_node __global *r)
+{
+	struct clBTree_node __global *root;
+
+	root = _clBTree_node_new(t, old->level + 1);
+	if(root == NULL)
+		return 0;
+
+	root->keys[0] = 0;
+	root->vals[0] = (uintptr_t) old;
+	root->keys[1] = r->keys[0];
+	root->vals[1] = (uintptr_t) r;
+	root->count = 2;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	if(atom_cmpxchg((volatile uintptr_t __global *) &t->root,
+			(uintptr_t) old, (uintptr_t) root) == (uintptr_t) old)
+		return 1;
+
+	free(t->heap, (uintptr_t) root);
+	return 0;
+}
+
+/**
+ * _clBTree_insert_level() - Insert a separator after a split
+ * @t: Tree
+ * @key: Low key of the new node
+ * @child: The new node
+ * @level: Level to insert at
+ * @return 1 on success
+ *
+ * Parents are found by descending from the root again. Splits propagate up
+ * by iteration. If the root split but no new root was put on top, because
+ * its splitter ran out of heap, we try growing the tree ourselves and give
+ * up if there is no heap for that either.
+ */
+int
+_clBTree_insert_level(clBTree __global *t, uint32_t key,
+		struct clBTree_node __global *child, uint32_t level)
+{
+	struct clBTree_node __global *n, *r, *root;
+	unsigned int i;
+
+	while(1) {
+		/* The root may not have been put on top yet */
+		loop_infinite(i) {
+			n = _clBTree_find(t, key, level);
+			if(n != NULL)
+				break;
+
+			root = t->root;
+			r = root->right;
+			if(r != NULL && root->level + 1 == level &&
+			   !_clBTree_grow(t, root, r) && t->root == root)
+				return 0;
+		}
+		if(n == NULL || !_clBTree_lock(n))
+			return 0;
+
+		/* Split after we found it? Move right */
+		while(key >= n->high) {
+			r = n->right;
+			_clBTree_unlock(n);
+			n = r;
+			if(!_clBTree_lock(n))
+				return 0;
+		}
+
+		if(n->count < CLBTREE_KEYS) {
+			_clBTree_insert_at(n, key, (uintptr_t) child);
+			_clBTree_unlock(n);
+			return 1;
+		}
+
+		r = _clBTree_split(t, n);
+		if(r == NULL) {
+			_clBTree_unlock(n);
+			return 0;
+		}
+		if(key < r->keys[0])
+			_clBTree_insert_at(n, key, (uintptr_t) child);
+		else
+			_clBTree_insert_at(r, key, (uintptr_t) child);
+		_clBTree_unlock(n);
+
+		if(t->root == n && _clBTree_grow(t, n, r))
+			return 1;
+
+		/* No memory for a new root, nobody will ever find a parent */
+		if(t->root == n)
+			return 0;
+
+		key = r->keys[0];
+		child = r;
+		level++;
+	}
+}
+
+/**
+ * clBTree_add() - Insert a key unless present
+ * @t: Tree
+ * @key: Key, below CLBTREE_INF
+ * @value: Value
+ * @return value if inserted, the value already present for key otherwise.
+ *         NULL if the heap is exhausted or key is CLBTREE_INF.
+ */
+uintptr_t
+clBTree_add(clBTree __global *t, uint32_t key, uintptr_t value)
+{
+	struct clBTree_node __global *n, *r;
+	uintptr_t ret;
+	uint32_t i;
+
+	/* No node has a high key above it */
+	if(key == CLBTREE_INF)
+		return NULL;
+
+	n = _clBTree_find(t, key, 0);
+	if(n == NULL || !_clBTree_lock(n))
+		return NULL;
+
+	while(key >= n->high) {
+		r = n->right;
+		_clBTree_unlock(n);
+		n = r;
+		if(!_clBTree_lock(n))
+			return NULL;
+	}
+
+	for(i = 0; i < n->count; i++) {
+		if(n->keys[i] == key) {
+			ret = n->vals[i];
+			_clBTree_unlock(n);
+			return ret;
+		}
+	}
+
+	if(n->count < CLBTREE_KEYS) {
+		_clBTree_insert_at(n, key, value);
+		_clBTree_unlock(n);
+		return value;
+	}
+
+	r = _clBTree_split(t, n);
+	if(r == NULL) {
+		_clBTree_unlock(n);
+		return NULL;
+	}
+	if(key < r->keys[0])
+		_clBTree_insert_at(n, key, value);
+	else
+		_clBTree_insert_at(r, key, value);
+	_clBTree_unlock(n);
+
+	if(t->root == n && _clBTree_grow(t, n, r))
+		return value;
+
+	/* No memory for a new root, nobody will ever find a parent */
+	if(t->root == n)
+		return NULL;
+
+	if(!_clBTree_insert_level(t, r->keys[0], r, 1))
+		return NULL;
+
+	return value;
+}
+
+/**
+ * clBTree_get() - Look up a key
+ * @t: Tree
+ * @key: Key
+ * @return Value for key, NULL if not present
+ */
+uintptr_t
+clBTree_get(clBTree __global *t, uint32_t key)
+{
+	struct clBTree_node __global *n, *next;
+	uintptr_t ret;
+	uint32_t i, v;
+
+	if(key == CLBTREE_INF)
+		return NULL;
+
+	n = _clBTree_find(t, key, 0);
+	if(n == NULL)
+		return NULL;
+
+	while(1) {
+		v = _clBTree_read_begin(n);
+		if(key >= n->high) {
+			next = n->right;
+			if(_clBTree_read_valid(n, v))
+				n = next;
+			continue;
+		}
+
+		ret = NULL;
+		for(i = 0; i < n->count && i < CLBTREE_KEYS; i++) {
+			if(n->keys[i] == key) {
+				ret = n->vals[i];
+				break;
+			}
+		}
+
+		if(_clBTree_read_valid(n, v))
+			return ret;
+	}
+}
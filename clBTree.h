@@ -0,0 +1,74 @@
+/**
+ * clBTree.h
+ * Header include for concurrent OpenCL B-link tree
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef CLBTREE_H
+#define CLBTREE_H
+
+#include "clheap.h"
+#include "clQueue.h"
+
+#ifndef __OPENCL_CL_H
+#define uint32_t unsigned int
+#endif
+
+#define CLBTREE_KEYS 8			/**< Keys per node */
+#define CLBTREE_INF 0xffffffff		/**< High key of the rightmost nodes */
+
+#ifdef __OPENCL_CL_H
+typedef struct {
+	uint32_t heap;
+	uint32_t root;
+} clBTree_32;
+
+typedef struct {
+	uint64_t heap;
+	uint64_t root;
+} clBTree_64;
+
+extern cl_mem clBTree_create(cl_device_id, cl_context, cl_command_queue,
+		cl_program, cl_mem heap);
+#else
+/* Lehman-Yao B-link tree. Every node carries a high key and a link to its
+ * right sibling, so a reader that raced with a split can always recover by
+ * moving right. Readers are optimistic: they validate the node's version
+ * after reading it. Writers make the version odd while they hold the node.
+ *
+ * Keys in an inner node are the low keys of its children; keys[0] of the
+ * leftmost node on each level is 0. Fits a 128 byte KMA block on 64-bit. */
+struct clBTree_node {
+	volatile uint32_t version;	/**< Seqlock, odd while locked */
+	volatile uint32_t count;	/**< Keys in use */
+	uint32_t level;			/**< 0 for leaves */
+	volatile uint32_t high;		/**< Keys in this node are below high */
+	volatile uint32_t keys[CLBTREE_KEYS];
+	volatile uintptr_t vals[CLBTREE_KEYS]; /**< Values, or children */
+	struct clBTree_node __global * volatile right; /**< Right sibling */
+};
+
+typedef struct {
+	struct clheap __global *heap;
+	struct clBTree_node __global * volatile root;
+} clBTree;
+
+extern uintptr_t clBTree_add(clBTree __global *, uint32_t, uintptr_t);
+extern uintptr_t clBTree_get(clBTree __global *, uint32_t);
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * clHashMap.c
+ * Lock-free OpenCL hash map, C frontend
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clHashMap.h"
+
+cl_mem
+clHashMap_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem heap, cl_uint size_l2)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_mem m;
+	cl_kernel kernel;
+	size_t bytes, threads;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("clHashMap: could not discover device address space\n");
+		return NULL;
+	}
+
+	/* _clHashMap_hash shifts by 32 - size_l2, keep that below 32 */
+	if(size_l2 < 1)
+		size_l2 = 1;
+
+	threads = (size_t) 1 << size_l2;
+	if(bits == 32)
+		bytes = sizeof(clHashMap_32) + threads * sizeof(clHashMap_slot_32);
+	else
+		bytes = sizeof(clHashMap_64) + threads * sizeof(clHashMap_slot_64);
+
+	m = clCreateBuffer(ctx, CL_MEM_READ_WRITE, bytes, NULL, &error);
+	if(error) {
+		printf("clHashMap: Could not allocate hash map on-device\n");
+		return NULL;
+	}
+
+	/* Initialise kernel, one work-item per slot */
+	kernel = clCreateKernel(prg, "clHashMap_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("clHashMap: Could not create hash map init kernel: %i\n", error);
+		return NULL;
+	}
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &m);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &heap);
+	clSetKernelArg(kernel, 2, sizeof(cl_uint), &size_l2);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("clHashMap: Could not execute hash map init kernel: %i\n", error);
+		return NULL;
+	}
+	clReleaseKernel(kernel);
+
+	return m;
+}
@@ -0,0 +1,199 @@
+/**
+ * clHashMap.cl
+ * Lock-free open addressing hash map implementation in OpenCL
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clHashMap.h"
+
+/**
+ * _clHashMap_hash() - Home slot of a key
+ * @m: Hash map
+ * @key: Key
+ * Multiplicative hashing, keeps sequential keys apart.
+ */
+inline uint32_t
+_clHashMap_hash(clHashMap __global *m, uint32_t key)
+{
+	return (key * 2654435769u) >> (32 - m->size_l2);
+}
+
+/**
+ * _clHashMap_init() - Initialise a hash map using several work-items
+ * @m: Hash map
+ * @heap: Heap for overflow tables
+ * @size_l2: Log 2 of the number of slots following the header
+ * @id: Index of this work-item amongst the initialising work-items
+ * @stride: Number of initialising work-items
+ */
+void
+_clHashMap_init(clHashMap __global *m, struct clheap __global *heap,
+		uint32_t size_l2, size_t id, size_t stride)
+{
+	clHashMap_slot __global *slots = (clHashMap_slot __global *)(m + 1);
+	size_t i;
+
+	for(i = id; i < (1 << size_l2); i += stride) {
+		slots[i].key = CLHASHMAP_EMPTY;
+		slots[i].value = NULL;
+	}
+
+	if(id == 0) {
+		m->heap = heap;
+		m->next = NULL;
+		m->mask = (1 << size_l2) - 1;
+		m->size_l2 = size_l2;
+	}
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+}
+
+__kernel void
+clHashMap_init(void __global *map, void __global *hp, uint32_t size_l2)
+{
+	size_t pid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	_clHashMap_init((clHashMap __global *) map,
+			(struct clheap __global *) hp, size_l2, pid, j);
+}
+
+/**
+ * _clHashMap_next() - Return the overflow table of m, allocating if needed
+ * @m: Hash map
+ * @return Overflow table, NULL if the heap is exhausted
+ */
+clHashMap __global *
+_clHashMap_next(clHashMap __global *m)
+{
+	clHashMap __global *next;
+	uintptr_t old;
+
+	next = m->next;
+	if(next != NULL)
+		return next;
+
+	next = (clHashMap __global *) malloc(m->heap, sizeof(clHashMap) +
+			(sizeof(clHashMap_slot) << CLHASHMAP_OVERFLOW_L2));
+	if(next == NULL)
+		return m->next;
+
+	_clHashMap_init(next, m->heap, CLHASHMAP_OVERFLOW_L2, 0, 1);
+	old = atom_cmpxchg((volatile uintptr_t __global *) &m->next, NULL,
+			(uintptr_t) next);
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	if(old != NULL) {
+		free(m->heap, (uintptr_t) next);
+		next = (clHashMap __global *) old;
+	}
+
+	return next;
+}
+
+/**
+ * _clHashMap_value() - Wait for the value of a claimed slot
+ * @s: Slot
+ * @return The value, NULL if the inserter didn't show up in time
+ */
+uintptr_t
+_clHashMap_value(clHashMap_slot __global *s)
+{
+	uintptr_t value;
+	unsigned int i;
+
+	loop_infinite(i) {
+		value = s->value;
+		if(value != NULL)
+			break;
+	}
+
+	return value;
+}
+
+/**
+ * clHashMap_add() - Insert a key unless present
+ * @m: Hash map
+ * @key: Key, anything but CLHASHMAP_EMPTY
+ * @value: Value, not NULL
+ * @return value if inserted, the value already present for key otherwise.
+ *         NULL if the heap can't hold another overflow table.
+ */
+uintptr_t
+clHashMap_add(clHashMap __global *m, uint32_t key, uintptr_t value)
+{
+	clHashMap_slot __global *slots;
+	uint32_t h, k, old;
+
+	while(m != NULL) {
+		slots = (clHashMap_slot __global *)(m + 1);
+		h = _clHashMap_hash(m, key);
+
+		for(k = 0; k < CLHASHMAP_PROBE_MAX && k <= m->mask; k++) {
+			old = slots[(h + k) & m->mask].key;
+			if(old == CLHASHMAP_EMPTY)
+				old = atom_cmpxchg(&slots[(h + k) & m->mask].key,
+						CLHASHMAP_EMPTY, key);
+
+			if(old == CLHASHMAP_EMPTY) {
+				slots[(h + k) & m->mask].value = value;
+				mem_fence(CLK_GLOBAL_MEM_FENCE);
+				return value;
+			}
+
+			if(old == key)
+				return _clHashMap_value(&slots[(h + k) & m->mask]);
+		}
+
+		m = _clHashMap_next(m);
+	}
+
+	return NULL;
+}
+
+/**
+ * clHashMap_get() - Look up a key
+ * @m: Hash map
+ * @key: Key
+ * @return Value for key, NULL if not present
+ */
+uintptr_t
+clHashMap_get(clHashMap __global *m, uint32_t key)
+{
+	clHashMap_slot __global *slots;
+	uint32_t h, k, cur;
+
+	while(m != NULL) {
+		slots = (clHashMap_slot __global *)(m + 1);
+		h = _clHashMap_hash(m, key);
+
+		for(k = 0; k < CLHASHMAP_PROBE_MAX && k <= m->mask; k++) {
+			cur = slots[(h + k) & m->mask].key;
+			if(cur == key)
+				return _clHashMap_value(&slots[(h + k) & m->mask]);
+			if(cur == CLHASHMAP_EMPTY)
+				return NULL;
+		}
+
+		m = m->next;
+	}
+
+	return NULL;
+}
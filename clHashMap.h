@@ -0,0 +1,86 @@
+/**
+ * clHashMap.h
+ * Header include for lock-free OpenCL hash map
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef CLHASHMAP_H
+#define CLHASHMAP_H
+
+#include "clheap.h"
+#include "clQueue.h"
+
+#ifndef __OPENCL_CL_H
+#define uint32_t unsigned int
+#endif
+
+#define CLHASHMAP_EMPTY 0xffffffff	/**< Key of a free slot */
+#define CLHASHMAP_PROBE_MAX 32		/**< Probes before overflowing */
+#define CLHASHMAP_OVERFLOW_L2 7		/**< Log 2 of overflow table slots */
+
+#ifdef __OPENCL_CL_H
+typedef struct {
+	uint32_t heap;
+	uint32_t next;
+	uint32_t mask;
+	uint32_t size_l2;
+} clHashMap_32;
+
+typedef struct {
+	uint64_t heap;
+	uint64_t next;
+	uint32_t mask;
+	uint32_t size_l2;
+} clHashMap_64;
+
+typedef struct {
+	uint32_t key;
+	uint32_t value;
+} clHashMap_slot_32;
+
+typedef struct {
+	uint32_t key;
+	uint32_t pad;
+	uint64_t value;
+} clHashMap_slot_64;
+
+extern cl_mem clHashMap_create(cl_device_id, cl_context, cl_command_queue,
+		cl_program, cl_mem heap, cl_uint size_l2);
+#else
+/* A table of 2^size_l2 slots follows this header directly in memory. Keys
+ * are claimed by CAS on CLHASHMAP_EMPTY and never removed, so a lookup may
+ * stop at the first free slot. When CLHASHMAP_PROBE_MAX slots are taken
+ * the key goes to the next table, allocated from the heap on demand. */
+typedef struct clHashMap {
+	struct clheap __global *heap;
+	struct clHashMap __global * volatile next; /**< Overflow table */
+	uint32_t mask;			/**< Slots - 1 */
+	uint32_t size_l2;		/**< Log 2 of number of slots */
+} clHashMap;
+
+typedef struct {
+	volatile uint32_t key;
+	volatile uintptr_t value;	/**< NULL while being inserted */
+} clHashMap_slot;
+
+extern void _clHashMap_init(clHashMap __global *, struct clheap __global *,
+		uint32_t, size_t, size_t);
+extern uintptr_t clHashMap_add(clHashMap __global *, uint32_t, uintptr_t);
+extern uintptr_t clHashMap_get(clHashMap __global *, uint32_t);
+#endif
+
+#endif
@@ -32,39 +32,44 @@ clQueue_init(clqueue __global *q)
 }
 
 /**
- * enqueue() - Add an item to the queue
- * @q: Queue to add the item to
- * @item: Item to add to the queue
+ * enqueue_chain() - Add a linked chain of items to the queue at once
+ * @q: Queue to add the items to
+ * @first: First item, linked through next up to last
+ * @last: Last item
  * @return 1 iff enqueuing succeeded, 0 otherwise
+ *
+ * Costs the same atomics as a single item, nobody else can get in
+ * between the items.
  */
 int
-enqueue(clqueue __global *q, clqueue_item __global *item)
+enqueue_chain(clqueue __global *q, clqueue_item __global *first,
+		clqueue_item __global *last)
 {
 	clqueue_item __global *tail;
 	unsigned int i = 0, ret = 0;
 
-	if(item == NULL)
+	if(first == NULL || last == NULL)
 		return 0;
 
-	item->next = NULL;
+	last->next = NULL;
 	mem_fence(CLK_GLOBAL_MEM_FENCE);
 	loop_infinite(i) {
 		/* If tail == NULL, CAS me into there. */
 		tail = (clqueue_item __global *)
-				atom_cmpxchg(&q->tail, NULL, (uptr) item);
+				atom_cmpxchg(&q->tail, NULL, (uptr) last);
 		mem_fence(CLK_GLOBAL_MEM_FENCE);
 
 		if(tail == NULL) {
-			atom_cmpxchg(&q->head, NULL, (uptr) item);
+			atom_cmpxchg(&q->head, NULL, (uptr) first);
 			ret = 1;
 			break;
 		}
 
 		/* If not, add me to the tail of the list.
 		 * on failure someone else beat me to it: retry! */
-		if(atom_cmpxchg(&tail->next, NULL, (uptr) item) == NULL) {
+		if(atom_cmpxchg(&tail->next, NULL, (uptr) first) == NULL) {
 			mem_fence(CLK_GLOBAL_MEM_FENCE);
-			while(atom_cmpxchg(&q->tail, (uptr) tail, (uptr) item) != (uptr) tail);
+			while(atom_cmpxchg(&q->tail, (uptr) tail, (uptr) last) != (uptr) tail);
 			ret = 1;
 			break;
 		}
@@ -74,6 +79,18 @@ enqueue(clqueue __global *q, clqueue_item __global *item)
 	return ret;
 }
 
+/**
+ * enqueue() - Add an item to the queue
+ * @q: Queue to add the item to
+ * @item: Item to add to the queue
+ * @return 1 iff enqueuing succeeded, 0 otherwise
+ */
+int
+enqueue(clqueue __global *q, clqueue_item __global *item)
+{
+	return enqueue_chain(q, item, item);
+}
+
 /**
  * dequeue() - Remove and return the next item in the queue
  * @q: Queue to get the item from
@@ -162,3 +179,26 @@ clQueue_test_dequeue(clqueue __global *q, unsigned int __global *mem)
 		}
 	}
 }
+
+/* Dequeue one item per work-item and count how often each work-item's item
+ * of the previous test turns up. seen[global size] counts the misses. */
+__kernel void
+clQueue_test_drain(clqueue __global *q, unsigned int __global *mem,
+		unsigned int __global *seen)
+{
+	unsigned int pid = 0, i, j, idx;
+	clqueue_item __global *item;
+
+	/* First find global unique ID */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	item = (clqueue_item __global *) dequeue(q);
+	idx = ((unsigned int __global *) item - mem) / 2;
+	if(item == NULL || idx >= j)
+		atom_inc(&seen[j]);
+	else
+		atom_inc(&seen[idx]);
+}
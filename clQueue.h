@@ -79,6 +79,8 @@ extern cl_mem clQueue_create(cl_device_id, cl_context, cl_command_queue, cl_prog
 
 extern void clQueue_init(clqueue __global *);
 extern int enqueue(clqueue __global *, clqueue_item __global *);
+extern int enqueue_chain(clqueue __global *, clqueue_item __global *,
+		clqueue_item __global *);
 extern clqueue_item __global *dequeue(clqueue __global *);
 #endif
 
@@ -0,0 +1,76 @@
+/**
+ * clRingQueue.c
+ * Implementation of a bounded ring queue in OpenCL
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clRingQueue.h"
+
+cl_mem
+clRingQueue_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_uint slots_l2)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_mem q;
+	cl_kernel kernel;
+	size_t bytes, threads;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("clRingQueue: could not discover device address space\n");
+		return NULL;
+	}
+
+	threads = (size_t) 1 << slots_l2;
+	bytes = sizeof(clRingQueue);
+	if(bits == 32)
+		bytes += threads * sizeof(clRingQueue_slot_32);
+	else
+		bytes += threads * sizeof(clRingQueue_slot_64);
+
+	q = clCreateBuffer(ctx, CL_MEM_READ_WRITE, bytes, NULL, &error);
+	if(error) {
+		printf("clRingQueue: Could not allocate queue on-device\n");
+		return NULL;
+	}
+
+	/* Initialise kernel, one work-item per slot */
+	kernel = clCreateKernel(prg, "clRingQueue_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("clRingQueue: Could not create queue init kernel: %i\n", error);
+		return NULL;
+	}
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &q);
+	clSetKernelArg(kernel, 1, sizeof(cl_uint), &slots_l2);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("clRingQueue: Could not execute queue init kernel: %i\n", error);
+		return NULL;
+	}
+	clReleaseKernel(kernel);
+
+	return q;
+}
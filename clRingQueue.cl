@@ -0,0 +1,238 @@
+/**
+ * clRingQueue.cl
+ * Bounded ring queue implementation in OpenCL
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clRingQueue.h"
+
+/**
+ * _clRingQueue_slot() - Return the slot belonging to a ticket
+ * @q: Ring queue
+ * @ticket: Enqueue or dequeue ticket
+ */
+inline clRingQueue_slot __global *
+_clRingQueue_slot(clRingQueue __global *q, uint32_t ticket)
+{
+	clRingQueue_slot __global *slots = (clRingQueue_slot __global *)(q + 1);
+
+	return &slots[ticket & q->mask];
+}
+
+/**
+ * _clRingQueue_init() - Initialise a ring queue using several work-items
+ * @q: Ring queue
+ * @slots_l2: Log 2 of the number of slots following the header
+ * @id: Index of this work-item amongst the initialising work-items
+ * @stride: Number of initialising work-items
+ */
+void
+_clRingQueue_init(clRingQueue __global *q, uint32_t slots_l2, size_t id,
+		size_t stride)
+{
+	clRingQueue_slot __global *slots = (clRingQueue_slot __global *)(q + 1);
+	size_t i;
+
+	for(i = id; i < (1 << slots_l2); i += stride) {
+		slots[i].seq = i;
+		slots[i].data = NULL;
+	}
+
+	if(id == 0) {
+		q->head = 0;
+		q->tail = 0;
+		q->items = 0;
+		q->space = 1 << slots_l2;
+		q->mask = (1 << slots_l2) - 1;
+		q->slots_l2 = slots_l2;
+	}
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+}
+
+__kernel void
+clRingQueue_init(void __global *queue, uint32_t slots_l2)
+{
+	size_t pid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	_clRingQueue_init((clRingQueue __global *) queue, slots_l2, pid, j);
+}
+
+/**
+ * ring_enqueue() - Add an item to the ring queue
+ * @q: Queue to add the item to
+ * @item: Item to add to the queue
+ * @return 1 iff enqueuing succeeded, 0 if the queue is full
+ *
+ * A free slot is reserved before taking a ticket. A failed reservation only
+ * makes concurrent enqueuers see a full queue spuriously, it never hands out
+ * a ticket for which no slot will become available.
+ *
+ * Where loop_infinite is bounded, giving up on the slot fails too. The ticket
+ * can't be given back, but the slot is left alone rather than overwritten.
+ */
+int
+ring_enqueue(clRingQueue __global *q, uintptr_t item)
+{
+	clRingQueue_slot __global *slot;
+	unsigned int i = 0;
+	uint32_t ticket;
+
+	if(item == NULL)
+		return 0;
+
+	if(atom_dec(&q->space) <= 0) {
+		atom_inc(&q->space);
+		return 0;
+	}
+
+	ticket = atom_inc(&q->tail);
+	slot = _clRingQueue_slot(q, ticket);
+
+	/* The dequeuer of the previous lap has reserved its item already, it
+	 * merely has to finish reading it. */
+	loop_infinite(i) {
+		if(slot->seq == ticket)
+			break;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	}
+	if(slot->seq != ticket)
+		return 0;
+
+	slot->data = item;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	slot->seq = ticket + 1;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	atom_inc(&q->items);
+
+	return 1;
+}
+
+/**
+ * ring_dequeue() - Remove and return the next item in the ring queue
+ * @q: Queue to get the item from
+ * @return The next queue item, NULL if the queue is empty or the item
+ *         didn't show up before loop_infinite ran out.
+ */
+uintptr_t
+ring_dequeue(clRingQueue __global *q)
+{
+	clRingQueue_slot __global *slot;
+	unsigned int i = 0;
+	uint32_t ticket;
+	uintptr_t item;
+
+	if(atom_dec(&q->items) <= 0) {
+		atom_inc(&q->items);
+		return NULL;
+	}
+
+	ticket = atom_inc(&q->head);
+	slot = _clRingQueue_slot(q, ticket);
+
+	/* Items are published out of ticket order, the enqueuer holding my
+	 * ticket is guaranteed to be on its way though. */
+	loop_infinite(i) {
+		if(slot->seq == ticket + 1)
+			break;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	}
+	if(slot->seq != ticket + 1)
+		return NULL;
+
+	item = slot->data;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	slot->seq = ticket + q->mask + 1;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	atom_inc(&q->space);
+
+	return item;
+}
+
+/* Test enqueueing. */
+__kernel void
+clRingQueue_test_enqueue(void __global *queue, uintptr_t __global *mem)
+{
+	clRingQueue __global *q = (clRingQueue __global *) queue;
+	size_t pid = 0, j;
+	unsigned int i;
+
+	/* First find global unique ID */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	mem[pid] = pid;
+	ring_enqueue(q, (uintptr_t) &mem[pid]);
+}
+
+/* Test enqueueing, dequeueing. */
+__kernel void
+clRingQueue_test_dequeue(void __global *queue, uintptr_t __global *mem)
+{
+	clRingQueue __global *q = (clRingQueue __global *) queue;
+	size_t pid = 0, j;
+	unsigned int i;
+	uintptr_t item;
+
+	/* First find global unique ID */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	mem[pid] = pid;
+	ring_enqueue(q, (uintptr_t) &mem[pid]);
+
+	/* Do the shuffle */
+	for(i = 0; i < 10; i++) {
+		item = ring_dequeue(q);
+		if(item != NULL)
+			ring_enqueue(q, item);
+	}
+}
+
+/* Dequeue one item per work-item and count how often each work-item's item
+ * of the previous test turns up. seen[global size] counts the misses. */
+__kernel void
+clRingQueue_test_drain(void __global *queue, uintptr_t __global *mem,
+		unsigned int __global *seen)
+{
+	clRingQueue __global *q = (clRingQueue __global *) queue;
+	size_t pid = 0, j, idx;
+	unsigned int i;
+	uintptr_t item;
+
+	/* First find global unique ID */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	item = ring_dequeue(q);
+	idx = ((uintptr_t __global *) item) - mem;
+	if(item == NULL || idx >= j)
+		atom_inc(&seen[j]);
+	else
+		atom_inc(&seen[idx]);
+}
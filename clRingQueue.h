@@ -0,0 +1,68 @@
+/**
+ * clRingQueue.h
+ * Header include for bounded OpenCL ring queue
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef CLRINGQUEUE_H
+#define CLRINGQUEUE_H
+
+#include "clQueue.h"
+
+#ifndef __OPENCL_CL_H
+#define uint32_t unsigned int
+#endif
+
+/* A ring of 2^slots_l2 slots follows this header directly in memory. Items
+ * are handed out by fetch-and-add tickets on head and tail, a slot belongs to
+ * ticket t when its sequence number equals t (empty) or t + 1 (filled). */
+typedef struct {
+	volatile uint32_t head;		/**< Dequeue ticket counter */
+	volatile uint32_t tail;		/**< Enqueue ticket counter */
+	volatile int items;		/**< Published items, guards empty */
+	volatile int space;		/**< Free slots, guards full */
+	uint32_t mask;			/**< Slots - 1 */
+	uint32_t slots_l2;		/**< Log 2 of number of slots */
+} clRingQueue;
+
+#ifdef __OPENCL_CL_H
+typedef struct {
+	uint32_t seq;
+	uint32_t data;
+} clRingQueue_slot_32;
+
+typedef struct {
+	uint32_t seq;
+	uint32_t pad;
+	uint64_t data;
+} clRingQueue_slot_64;
+
+extern cl_mem clRingQueue_create(cl_device_id, cl_context, cl_command_queue,
+		cl_program, cl_uint slots_l2);
+#else
+typedef struct {
+	volatile uint32_t seq;		/**< Ticket owning this slot */
+	volatile uintptr_t data;	/**< Payload, NULL is not allowed */
+} clRingQueue_slot;
+
+extern void clRingQueue_init(void __global *, uint32_t);
+extern void _clRingQueue_init(clRingQueue __global *, uint32_t, size_t, size_t);
+extern int ring_enqueue(clRingQueue __global *, uintptr_t);
+extern uintptr_t ring_dequeue(clRingQueue __global *);
+#endif
+
+#endif
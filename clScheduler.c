@@ -0,0 +1,84 @@
+/**
+ * clScheduler.c
+ * Persistent-threads task scheduler, C frontend
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clScheduler.h"
+
+cl_mem
+clScheduler_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem heap, cl_uint groups, cl_uint slots_l2)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_mem s;
+	cl_kernel kernel;
+	size_t bytes, deque, threads;
+
+	if(groups == 0)
+		return NULL;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("clScheduler: could not discover device address space\n");
+		return NULL;
+	}
+
+	threads = (size_t) 1 << slots_l2;
+	if(bits == 32) {
+		bytes = sizeof(clScheduler_32);
+		deque = sizeof(clRingQueue) + threads * sizeof(clRingQueue_slot_32);
+	} else {
+		bytes = sizeof(clScheduler_64);
+		deque = sizeof(clRingQueue) + threads * sizeof(clRingQueue_slot_64);
+	}
+	bytes += groups * deque;
+
+	s = clCreateBuffer(ctx, CL_MEM_READ_WRITE, bytes, NULL, &error);
+	if(error) {
+		printf("clScheduler: Could not allocate scheduler on-device\n");
+		return NULL;
+	}
+
+	/* Initialise kernel, one work-item per deque slot */
+	kernel = clCreateKernel(prg, "clScheduler_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("clScheduler: Could not create init kernel: %i\n", error);
+		return NULL;
+	}
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &s);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &heap);
+	clSetKernelArg(kernel, 2, sizeof(cl_uint), &groups);
+	clSetKernelArg(kernel, 3, sizeof(cl_uint), &slots_l2);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("clScheduler: Could not execute init kernel: %i\n", error);
+		return NULL;
+	}
+	clReleaseKernel(kernel);
+
+	return s;
+}
@@ -0,0 +1,171 @@
+/**
+ * clScheduler.cl
+ * Persistent-threads task scheduler with work stealing
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clScheduler.h"
+
+/**
+ * _clScheduler_deque() - Return the deque of given work-group
+ * @s: Scheduler
+ * @group: Work-group index, modulo the number of deques
+ */
+clRingQueue __global *
+_clScheduler_deque(clScheduler __global *s, size_t group)
+{
+	char __global *deques = (char __global *)(s + 1);
+	size_t stride;
+
+	stride = sizeof(clRingQueue) + (sizeof(clRingQueue_slot) << s->slots_l2);
+
+	return (clRingQueue __global *) &deques[(group % s->groups) * stride];
+}
+
+/**
+ * _clScheduler_group() - Flattened work-group ID of the calling work-item
+ */
+size_t
+_clScheduler_group(void)
+{
+	size_t gid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		gid += j * get_group_id(i);
+		j *= get_num_groups(i);
+	}
+
+	return gid;
+}
+
+__kernel void
+clScheduler_init(void __global *sched, void __global *hp, uint32_t groups,
+		uint32_t slots_l2)
+{
+	clScheduler __global *s = (clScheduler __global *) sched;
+	size_t pid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	if(pid == 0) {
+		s->heap = (struct clheap __global *) hp;
+		s->pending = 0;
+		s->groups = groups;
+		s->slots_l2 = slots_l2;
+		clQueue_init(&s->overflow);
+	}
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	/* Stride calculation needs the header, don't use _clScheduler_deque */
+	for(i = 0; i < groups; i++) {
+		_clRingQueue_init((clRingQueue __global *)
+			((char __global *)(s + 1) + i * (sizeof(clRingQueue) +
+			(sizeof(clRingQueue_slot) << slots_l2))), slots_l2, pid, j);
+	}
+}
+
+/**
+ * clScheduler_spawn() - Create a task and push it on my work-group's deque
+ * @s: Scheduler
+ * @type: Task type, passed on to clTask_run()
+ * @arg: Task argument
+ * @data: Task payload
+ * @return 1 on success, 0 if no memory was left for the task or it could
+ *         not be queued
+ *
+ * OpenCL C forbids recursion, so a task that fits neither the deque nor the
+ * overflow queue can't be run inline from clTask_run(). Instead it is
+ * withdrawn from the pending count and reported back as a failed spawn, so
+ * clScheduler_run() still terminates.
+ */
+int
+clScheduler_spawn(clScheduler __global *s, unsigned int type,
+		unsigned int arg, uintptr_t data)
+{
+	struct clTask __global *task;
+
+	task = (struct clTask __global *) malloc(s->heap, sizeof(struct clTask));
+	if(!task)
+		return 0;
+
+	task->type = type;
+	task->arg = arg;
+	task->data = data;
+
+	/* Count before publishing, or the scheduler may terminate early */
+	atom_inc(&s->pending);
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	if(!ring_enqueue(_clScheduler_deque(s, _clScheduler_group()),
+			(uintptr_t) task) && !enqueue(&s->overflow, &task->q)) {
+		free(s->heap, (uintptr_t) task);
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		atom_dec(&s->pending);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * clScheduler_run() - Execute tasks until none are left
+ * @s: Scheduler
+ *
+ * Every work-item pops from its own work-group's deque first, then tries to
+ * steal from the other work-groups and finally takes from the overflow list.
+ * Returns when no spawned task remains unfinished. Launch no more work-groups
+ * than fit on the device at once, the scheduler is meant for persistent
+ * threads.
+ */
+void
+clScheduler_run(clScheduler __global *s)
+{
+	struct clTask __global *task;
+	size_t group = _clScheduler_group();
+	unsigned int victim;
+
+	while(1) {
+		task = (struct clTask __global *)
+				ring_dequeue(_clScheduler_deque(s, group));
+
+		for(victim = 1; task == NULL && victim < s->groups; victim++) {
+			task = (struct clTask __global *)
+				ring_dequeue(_clScheduler_deque(s, group + victim));
+		}
+
+		if(task == NULL)
+			task = (struct clTask __global *) dequeue(&s->overflow);
+
+		if(task != NULL) {
+			clTask_run(s, task);
+			free(s->heap, (uintptr_t) task);
+			mem_fence(CLK_GLOBAL_MEM_FENCE);
+			atom_dec(&s->pending);
+			continue;
+		}
+
+		/* Nothing to do. Stop if nobody can create new work either. */
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		if(s->pending == 0)
+			break;
+	}
+}
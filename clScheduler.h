@@ -0,0 +1,78 @@
+/**
+ * clScheduler.h
+ * Persistent-threads task scheduler with work stealing
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef CLSCHEDULER_H
+#define CLSCHEDULER_H
+
+#include "clheap.h"
+#include "clQueue.h"
+#include "clRingQueue.h"
+
+#ifdef __OPENCL_CL_H
+#include <stdint.h>
+
+/* The scheduler header is followed by one clRingQueue (plus slots) per
+ * work-group. */
+typedef struct {
+	uint32_t heap;
+	uint32_t pending;
+	uint32_t groups;
+	uint32_t slots_l2;
+	clqueue_32 overflow;
+} clScheduler_32;
+
+typedef struct {
+	uint64_t heap;
+	uint32_t pending;
+	uint32_t groups;
+	uint32_t slots_l2;
+	uint32_t pad;
+	clqueue_64 overflow;
+} clScheduler_64;
+
+extern cl_mem clScheduler_create(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem heap, cl_uint groups,
+		cl_uint slots_l2);
+#else
+typedef struct {
+	struct clheap __global *heap;	/**< Heap tasks are allocated from */
+	volatile uint32_t pending;	/**< Spawned, unfinished tasks */
+	uint32_t groups;		/**< Number of per work-group deques */
+	uint32_t slots_l2;		/**< Log 2 of slots per deque */
+	clqueue overflow;		/**< Tasks that did not fit a deque */
+} clScheduler;
+
+struct clTask {
+	clqueue_item q;			/**< Overflow list link
+					  !!!: Keep me on top! */
+	unsigned int type;		/**< User defined task type */
+	unsigned int arg;		/**< User defined argument */
+	uintptr_t data;			/**< User defined payload */
+};
+
+extern int clScheduler_spawn(clScheduler __global *, unsigned int,
+		unsigned int, uintptr_t);
+extern void clScheduler_run(clScheduler __global *);
+
+/* To be provided by the program using the scheduler */
+extern void clTask_run(clScheduler __global *, struct clTask __global *);
+#endif
+
+#endif
@@ -0,0 +1,384 @@
+/**
+ * clSort.c
+ * OpenCL radix sort and stream compaction, C frontend
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clSort.h"
+
+/* Kernels and tile sums for a multi-group scan */
+struct _clSort_scanner {
+	cl_kernel reduce;
+	cl_kernel scan;
+	cl_kernel down;
+	cl_mem sums;		/**< CLSORT_GROUPS_MAX + 1 tile sums */
+};
+
+int
+_clSort_scanner_create(cl_context ctx, cl_program prg,
+		struct _clSort_scanner *s)
+{
+	cl_int error, e;
+
+	s->reduce = clCreateKernel(prg, "clSort_scan_reduce", &error);
+	s->scan = clCreateKernel(prg, "clSort_scan", &e);
+	error |= e;
+	s->down = clCreateKernel(prg, "clSort_scan_down", &e);
+	error |= e;
+	if(error != CL_SUCCESS) {
+		printf("clSort: Could not create scan kernels: %i\n", error);
+		return error;
+	}
+
+	s->sums = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+			(CLSORT_GROUPS_MAX + 1) * sizeof(cl_uint), NULL, &error);
+	if(error) {
+		printf("clSort: Could not allocate scan buffer on-device\n");
+		return error;
+	}
+
+	return 0;
+}
+
+void
+_clSort_scanner_release(struct _clSort_scanner *s)
+{
+	clReleaseKernel(s->reduce);
+	clReleaseKernel(s->scan);
+	clReleaseKernel(s->down);
+	clReleaseMemObject(s->sums);
+}
+
+/**
+ * _clSort_scan_single() - Exclusive prefix sum of n values as one work-group
+ */
+int
+_clSort_scan_single(cl_command_queue cq, cl_kernel scan, cl_mem data,
+		cl_uint n)
+{
+	cl_int error;
+	size_t threads = CLSORT_LOCAL;
+
+	clSetKernelArg(scan, 0, sizeof(cl_mem), &data);
+	clSetKernelArg(scan, 1, sizeof(cl_uint), &n);
+	clSetKernelArg(scan, 2, CLSORT_LOCAL * sizeof(cl_uint), NULL);
+
+	error = clEnqueueNDRangeKernel(cq, scan, 1, NULL, &threads, &threads, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clSort: Could not execute scan kernel: %i\n", error);
+		return error;
+	}
+
+	return 0;
+}
+
+/**
+ * _clSort_scan() - Exclusive prefix sum of n values, total in data[n]
+ *
+ * Reduce every tile, scan the tile sums in a single work-group, then scan
+ * every tile starting from its sum. Same tiling as the sort passes.
+ */
+int
+_clSort_scan(cl_command_queue cq, struct _clSort_scanner *s, cl_mem data,
+		cl_uint n)
+{
+	cl_int error;
+	cl_uint groups;
+	size_t threads, local = CLSORT_LOCAL;
+
+	groups = (n + CLSORT_LOCAL - 1) / CLSORT_LOCAL;
+	if(groups > CLSORT_GROUPS_MAX)
+		groups = CLSORT_GROUPS_MAX;
+	if(groups <= 1)
+		return _clSort_scan_single(cq, s->scan, data, n);
+	threads = groups * local;
+
+	clSetKernelArg(s->reduce, 0, sizeof(cl_mem), &data);
+	clSetKernelArg(s->reduce, 1, sizeof(cl_uint), &n);
+	clSetKernelArg(s->reduce, 2, sizeof(cl_mem), &s->sums);
+	error = clEnqueueNDRangeKernel(cq, s->reduce, 1, NULL, &threads, &local, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clSort: Could not execute scan reduce kernel: %i\n", error);
+		return error;
+	}
+
+	error = _clSort_scan_single(cq, s->scan, s->sums, groups);
+	if(error)
+		return error;
+
+	clSetKernelArg(s->down, 0, sizeof(cl_mem), &data);
+	clSetKernelArg(s->down, 1, sizeof(cl_uint), &n);
+	clSetKernelArg(s->down, 2, sizeof(cl_mem), &s->sums);
+	error = clEnqueueNDRangeKernel(cq, s->down, 1, NULL, &threads, &local, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clSort: Could not execute scan down kernel: %i\n", error);
+		return error;
+	}
+
+	return 0;
+}
+
+/**
+ * clSort_radix() - Sort keys, and values along with them
+ * @keys: n keys, sorted in place
+ * @vals: n values, or NULL
+ * @return 0 on success, OpenCL error otherwise
+ */
+int
+clSort_radix(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem keys, cl_mem vals, cl_uint n)
+{
+	cl_int error;
+	cl_kernel count, scatter;
+	struct _clSort_scanner scan;
+	cl_mem tmpKeys, tmpVals = NULL, hist, src[2], dst[2];
+	cl_uint shift, groups;
+	size_t threads, local = CLSORT_LOCAL;
+
+	if(n == 0)
+		return 0;
+
+	groups = (n + CLSORT_LOCAL - 1) / CLSORT_LOCAL;
+	if(groups > CLSORT_GROUPS_MAX)
+		groups = CLSORT_GROUPS_MAX;
+	threads = groups * local;
+
+	tmpKeys = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &error);
+	if(vals)
+		tmpVals = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &error);
+	hist = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+			(CLSORT_RADIX * groups + 1) * sizeof(cl_uint), NULL, &error);
+	if(error) {
+		printf("clSort: Could not allocate sort buffers on-device\n");
+		return error;
+	}
+
+	count = clCreateKernel(prg, "clSort_count", &error);
+	scatter = clCreateKernel(prg, "clSort_scatter", &error);
+	if(error != CL_SUCCESS) {
+		printf("clSort: Could not create sort kernels: %i\n", error);
+		return error;
+	}
+
+	error = _clSort_scanner_create(ctx, prg, &scan);
+	if(error)
+		return error;
+
+	/* An even number of passes, so we end up where we started */
+	for(shift = 0; shift < 32; shift += CLSORT_RADIX_L2) {
+		if((shift / CLSORT_RADIX_L2) & 1) {
+			src[0] = tmpKeys; src[1] = tmpVals;
+			dst[0] = keys; dst[1] = vals;
+		} else {
+			src[0] = keys; src[1] = vals;
+			dst[0] = tmpKeys; dst[1] = tmpVals;
+		}
+
+		clSetKernelArg(count, 0, sizeof(cl_mem), &src[0]);
+		clSetKernelArg(count, 1, sizeof(cl_uint), &n);
+		clSetKernelArg(count, 2, sizeof(cl_uint), &shift);
+		clSetKernelArg(count, 3, sizeof(cl_mem), &hist);
+		error = clEnqueueNDRangeKernel(cq, count, 1, NULL, &threads, &local, 0, NULL, NULL);
+		if (error != CL_SUCCESS) {
+			printf("clSort: Could not execute count kernel: %i\n", error);
+			return error;
+		}
+
+		error = _clSort_scan(cq, &scan, hist, CLSORT_RADIX * groups);
+		if(error)
+			return error;
+
+		clSetKernelArg(scatter, 0, sizeof(cl_mem), &src[0]);
+		clSetKernelArg(scatter, 1, sizeof(cl_mem), &src[1]);
+		clSetKernelArg(scatter, 2, sizeof(cl_mem), &dst[0]);
+		clSetKernelArg(scatter, 3, sizeof(cl_mem), &dst[1]);
+		clSetKernelArg(scatter, 4, sizeof(cl_uint), &n);
+		clSetKernelArg(scatter, 5, sizeof(cl_uint), &shift);
+		clSetKernelArg(scatter, 6, sizeof(cl_mem), &hist);
+		error = clEnqueueNDRangeKernel(cq, scatter, 1, NULL, &threads, &local, 0, NULL, NULL);
+		if (error != CL_SUCCESS) {
+			printf("clSort: Could not execute scatter kernel: %i\n", error);
+			return error;
+		}
+	}
+
+	error = clFinish(cq);
+	if(error != CL_SUCCESS) {
+		printf("clSort: failed to sort: %i\n", error);
+		return error;
+	}
+
+	clReleaseKernel(count);
+	clReleaseKernel(scatter);
+	_clSort_scanner_release(&scan);
+	clReleaseMemObject(tmpKeys);
+	if(tmpVals)
+		clReleaseMemObject(tmpVals);
+	clReleaseMemObject(hist);
+
+	return 0;
+}
+
+/**
+ * clSort_prefix_sum() - Exclusive prefix sum
+ * @data: n + 1 values, the first n replaced by their prefix sum and the last
+ * by the total
+ * @return 0 on success, OpenCL error otherwise
+ */
+int
+clSort_prefix_sum(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem data, cl_uint n)
+{
+	cl_int error;
+	struct _clSort_scanner scan;
+
+	error = _clSort_scanner_create(ctx, prg, &scan);
+	if(error)
+		return error;
+
+	error = _clSort_scan(cq, &scan, data, n);
+	error |= clFinish(cq);
+	_clSort_scanner_release(&scan);
+
+	return error;
+}
+
+/**
+ * clSort_unique_marks() - Number the runs of equal keys
+ * @keys: n sorted keys
+ * @count: Return value for the number of unique keys
+ * @return Buffer of n + 1 entries, entry i holding the number of runs that
+ * start before key i. NULL on error.
+ */
+cl_mem
+clSort_unique_marks(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem keys, cl_uint n, cl_uint *count)
+{
+	cl_int error;
+	cl_kernel mark;
+	struct _clSort_scanner scan;
+	cl_mem marks;
+	size_t threads, local = CLSORT_LOCAL;
+
+	if(n == 0)
+		return NULL;
+
+	marks = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (n + 1) * sizeof(cl_uint), NULL, &error);
+	if(error) {
+		printf("clSort: Could not allocate marks on-device\n");
+		return NULL;
+	}
+
+	mark = clCreateKernel(prg, "clSort_unique_mark", &error);
+	if(error != CL_SUCCESS) {
+		printf("clSort: Could not create unique kernels: %i\n", error);
+		return NULL;
+	}
+
+	if(_clSort_scanner_create(ctx, prg, &scan))
+		return NULL;
+
+	threads = ((n + CLSORT_LOCAL - 1) / CLSORT_LOCAL) * CLSORT_LOCAL;
+	clSetKernelArg(mark, 0, sizeof(cl_mem), &keys);
+	clSetKernelArg(mark, 1, sizeof(cl_uint), &n);
+	clSetKernelArg(mark, 2, sizeof(cl_mem), &marks);
+	error = clEnqueueNDRangeKernel(cq, mark, 1, NULL, &threads, &local, 0, NULL, NULL);
+	if (error != CL_SUCCESS) {
+		printf("clSort: Could not execute mark kernel: %i\n", error);
+		return NULL;
+	}
+
+	if(_clSort_scan(cq, &scan, marks, n))
+		return NULL;
+
+	error = clEnqueueReadBuffer(cq, marks, CL_TRUE, n * sizeof(cl_uint),
+			sizeof(cl_uint), count, 0, NULL, NULL);
+	if(error != CL_SUCCESS) {
+		printf("clSort: Could not read unique count: %i\n", error);
+		return NULL;
+	}
+
+	clReleaseKernel(mark);
+	_clSort_scanner_release(&scan);
+
+	return marks;
+}
+
+/**
+ * clSort_unique() - Drop all but the first of every run of equal keys
+ * @keys: n sorted keys
+ * @vals: n values, or NULL
+ * @outKeys: Return value for a new buffer holding the unique keys
+ * @outVals: Return value for their values, untouched if vals is NULL
+ * @return Number of unique keys, 0 on error
+ */
+cl_uint
+clSort_unique(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem keys, cl_mem vals, cl_uint n,
+		cl_mem *outKeys, cl_mem *outVals)
+{
+	cl_int error;
+	cl_kernel compact;
+	cl_mem marks, ov = NULL;
+	cl_uint total;
+	size_t threads, local = CLSORT_LOCAL;
+
+	marks = clSort_unique_marks(dev, ctx, cq, prg, keys, n, &total);
+	if(!marks)
+		return 0;
+
+	compact = clCreateKernel(prg, "clSort_compact", &error);
+	if(error != CL_SUCCESS) {
+		printf("clSort: Could not create compact kernel: %i\n", error);
+		return 0;
+	}
+
+	*outKeys = clCreateBuffer(ctx, CL_MEM_READ_WRITE, total * sizeof(cl_uint), NULL, &error);
+	if(vals)
+		ov = clCreateBuffer(ctx, CL_MEM_READ_WRITE, total * sizeof(cl_uint), NULL, &error);
+	if(error) {
+		printf("clSort: Could not allocate unique keys on-device\n");
+		return 0;
+	}
+
+	threads = ((n + CLSORT_LOCAL - 1) / CLSORT_LOCAL) * CLSORT_LOCAL;
+	clSetKernelArg(compact, 0, sizeof(cl_mem), &keys);
+	clSetKernelArg(compact, 1, sizeof(cl_mem), &vals);
+	clSetKernelArg(compact, 2, sizeof(cl_uint), &n);
+	clSetKernelArg(compact, 3, sizeof(cl_mem), &marks);
+	clSetKernelArg(compact, 4, sizeof(cl_mem), outKeys);
+	clSetKernelArg(compact, 5, sizeof(cl_mem), &ov);
+	error = clEnqueueNDRangeKernel(cq, compact, 1, NULL, &threads, &local, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("clSort: Could not execute compact kernel: %i\n", error);
+		return 0;
+	}
+
+	if(vals)
+		*outVals = ov;
+
+	clReleaseKernel(compact);
+	clReleaseMemObject(marks);
+
+	return total;
+}
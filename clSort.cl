@@ -0,0 +1,276 @@
+/**
+ * clSort.cl
+ * LSD radix sort and stream compaction in OpenCL
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clSort.h"
+
+/* Each work-group sorts a contiguous tile, so stable ranks within a tile
+ * plus an exclusive scan over the per-tile digit counts, laid out digit
+ * major, give every key its place. */
+inline size_t
+_clSort_tile(unsigned int n)
+{
+	return (n + get_num_groups(0) - 1) / get_num_groups(0);
+}
+
+/**
+ * clSort_count() - Count digits per tile
+ * @keys: Keys
+ * @n: Number of keys
+ * @shift: Position of the digit
+ * @hist: Output, CLSORT_RADIX * groups counters, digit major
+ */
+__kernel void
+clSort_count(unsigned int __global *keys, unsigned int n, unsigned int shift,
+		unsigned int __global *hist)
+{
+	unsigned int __local cnt[CLSORT_RADIX];
+	size_t lid = get_local_id(0), g = get_group_id(0), tile, i, end;
+
+	if(lid < CLSORT_RADIX)
+		cnt[lid] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	tile = _clSort_tile(n);
+	end = min((g + 1) * tile, (size_t) n);
+	for(i = g * tile + lid; i < end; i += get_local_size(0))
+		atom_inc(&cnt[(keys[i] >> shift) & (CLSORT_RADIX - 1)]);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(lid < CLSORT_RADIX)
+		hist[lid * get_num_groups(0) + g] = cnt[lid];
+}
+
+/**
+ * clSort_scan() - Exclusive prefix sum, as a single work-group
+ * @data: Values, replaced by their prefix sum. data[n] receives the total.
+ * @n: Number of values
+ * @rMem: Scratch, one entry per work-item
+ *
+ * Every work-item sums a contiguous block, work-item 0 scans the block sums.
+ * Only meant for short arrays, such as the tile sums of clSort_scan_reduce.
+ */
+__kernel void
+clSort_scan(unsigned int __global *data, unsigned int n,
+		unsigned int __local *rMem)
+{
+	size_t lid = get_local_id(0), lsize = get_local_size(0), i, first, last;
+	unsigned int sum, v;
+
+	/* n * lid overflows a 32-bit size_t */
+	first = ((ulong) n * lid) / lsize;
+	last = ((ulong) n * (lid + 1)) / lsize;
+	for(i = first, sum = 0; i < last; i++)
+		sum += data[i];
+	rMem[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(lid == 0) {
+		for(i = 0, sum = 0; i < lsize; i++) {
+			v = rMem[i];
+			rMem[i] = sum;
+			sum += v;
+		}
+		data[n] = sum;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(i = first, sum = rMem[lid]; i < last; i++) {
+		v = data[i];
+		data[i] = sum;
+		sum += v;
+	}
+}
+
+/**
+ * clSort_scan_reduce() - Sum every tile, first pass of a multi-group scan
+ * @data: Values
+ * @n: Number of values
+ * @sums: Output, one sum per work-group, scanned by clSort_scan next
+ *
+ * Tiles are laid out as for the sort. Run with CLSORT_LOCAL work-items per
+ * work-group.
+ */
+__kernel void
+clSort_scan_reduce(unsigned int __global *data, unsigned int n,
+		unsigned int __global *sums)
+{
+	unsigned int __local part[CLSORT_LOCAL];
+	size_t lid = get_local_id(0), g = get_group_id(0), tile, i, end, s;
+	unsigned int sum = 0;
+
+	tile = _clSort_tile(n);
+	end = min((g + 1) * tile, (size_t) n);
+	for(i = g * tile + lid; i < end; i += CLSORT_LOCAL)
+		sum += data[i];
+	part[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(s = CLSORT_LOCAL >> 1; s > 0; s >>= 1) {
+		if(lid < s)
+			part[lid] += part[lid + s];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if(lid == 0)
+		sums[g] = part[0];
+}
+
+/**
+ * clSort_scan_down() - Scan every tile, last pass of a multi-group scan
+ * @data: Values, replaced by their prefix sum. data[n] receives the total.
+ * @n: Number of values
+ * @sums: Scanned tile sums, sums[groups] holding the total
+ *
+ * Each work-group scans its tile CLSORT_LOCAL values at a time, carrying the
+ * running sum from one chunk to the next.
+ */
+__kernel void
+clSort_scan_down(unsigned int __global *data, unsigned int n,
+		unsigned int __global *sums)
+{
+	unsigned int __local part[CLSORT_LOCAL];
+	unsigned int __local carry;
+	size_t lid = get_local_id(0), g = get_group_id(0), tile, start, end, c, s;
+	unsigned int v, t;
+
+	tile = _clSort_tile(n);
+	start = g * tile;
+	end = min(start + tile, (size_t) n);
+	if(lid == 0)
+		carry = sums[g];
+
+	for(c = start; c < end; c += CLSORT_LOCAL) {
+		v = (c + lid < end) ? data[c + lid] : 0;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		part[lid] = v;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		/* Inclusive Hillis-Steele scan of the chunk */
+		for(s = 1; s < CLSORT_LOCAL; s <<= 1) {
+			t = (lid >= s) ? part[lid - s] : 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			part[lid] += t;
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+
+		if(c + lid < end)
+			data[c + lid] = carry + part[lid] - v;
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if(lid == CLSORT_LOCAL - 1)
+			carry += part[lid];
+	}
+
+	if(g == get_num_groups(0) - 1 && lid == 0)
+		data[n] = sums[get_num_groups(0)];
+}
+
+/**
+ * clSort_scatter() - Move keys (and values) to their place for this digit
+ * @hist: Scanned output of clSort_count
+ * @vals, @valsOut: May be NULL
+ *
+ * Tiles are processed CLSORT_LOCAL keys at a time. A key's rank amongst the
+ * keys with the same digit before it in the chunk keeps the sort stable.
+ */
+__kernel void
+clSort_scatter(unsigned int __global *keys, unsigned int __global *vals,
+		unsigned int __global *keysOut, unsigned int __global *valsOut,
+		unsigned int n, unsigned int shift, unsigned int __global *hist)
+{
+	unsigned int __local base[CLSORT_RADIX];
+	unsigned int __local digits[CLSORT_LOCAL];
+	size_t lid = get_local_id(0), g = get_group_id(0), tile, start, end, c;
+	unsigned int d, k, rank, last, key = 0;
+
+	if(lid < CLSORT_RADIX)
+		base[lid] = hist[lid * get_num_groups(0) + g];
+
+	tile = _clSort_tile(n);
+	start = g * tile;
+	end = min(start + tile, (size_t) n);
+
+	for(c = start; c < end; c += CLSORT_LOCAL) {
+		barrier(CLK_LOCAL_MEM_FENCE);
+		d = CLSORT_RADIX;
+		if(c + lid < end) {
+			key = keys[c + lid];
+			d = (key >> shift) & (CLSORT_RADIX - 1);
+		}
+		digits[lid] = d;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		rank = 0;
+		last = 1;
+		for(k = 0; k < CLSORT_LOCAL; k++) {
+			if(digits[k] != d)
+				continue;
+			if(k < lid)
+				rank++;
+			else if(k > lid)
+				last = 0;
+		}
+
+		if(d < CLSORT_RADIX) {
+			keysOut[base[d] + rank] = key;
+			if(vals)
+				valsOut[base[d] + rank] = vals[c + lid];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		/* The last of each digit moves the base along */
+		if(d < CLSORT_RADIX && last)
+			base[d] += rank + 1;
+	}
+}
+
+/**
+ * clSort_unique_mark() - Mark the first of every run of equal keys
+ * @marks: Output, n + 1 entries, the last one is left for clSort_scan
+ */
+__kernel void
+clSort_unique_mark(unsigned int __global *keys, unsigned int n,
+		unsigned int __global *marks)
+{
+	size_t i;
+
+	for(i = get_global_id(0); i < n; i += get_global_size(0))
+		marks[i] = (i == 0 || keys[i] != keys[i - 1]);
+}
+
+/**
+ * clSort_compact() - Keep the keys marked by clSort_unique_mark
+ * @pos: Scanned marks
+ * @vals, @valsOut: May be NULL
+ */
+__kernel void
+clSort_compact(unsigned int __global *keys, unsigned int __global *vals,
+		unsigned int n, unsigned int __global *pos,
+		unsigned int __global *keysOut, unsigned int __global *valsOut)
+{
+	size_t i;
+
+	for(i = get_global_id(0); i < n; i += get_global_size(0)) {
+		if(pos[i + 1] == pos[i])
+			continue;
+		keysOut[pos[i]] = keys[i];
+		if(vals)
+			valsOut[pos[i]] = vals[i];
+	}
+}
@@ -0,0 +1,42 @@
+/**
+ * clSort.h
+ * Header include for OpenCL radix sort and stream compaction
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef CLSORT_H
+#define CLSORT_H
+
+#define CLSORT_RADIX_L2 4		/**< Bits sorted per pass */
+#define CLSORT_RADIX (1 << CLSORT_RADIX_L2)
+#define CLSORT_LOCAL 128		/**< Work-group size of the sort kernels */
+#define CLSORT_GROUPS_MAX 256		/**< Work-groups per pass, at most */
+
+#ifdef __OPENCL_CL_H
+extern int clSort_radix(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem keys, cl_mem vals, cl_uint n);
+extern int clSort_prefix_sum(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem data, cl_uint n);
+extern cl_mem clSort_unique_marks(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem keys, cl_uint n,
+		cl_uint *count);
+extern cl_uint clSort_unique(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem keys, cl_mem vals,
+		cl_uint n, cl_mem *outKeys, cl_mem *outVals);
+#endif
+
+#endif
@@ -23,6 +23,9 @@
 /**
  * Do not ever change the key of a node after adding!
  * It could render the node unfindable..
+ *
+ * A deleted node with the same key does not count, the new node goes in its
+ * right subtree. Lookups do the same, so at most one live node per key.
  */
 unsigned int
 clTree_add(struct clTree __global *tree, struct clTree_node __global *node)
@@ -31,6 +34,7 @@ clTree_add(struct clTree __global *tree, struct clTree_node __global *node)
 	volatile struct clTree_node __global *cNow;
 	uintptr_t cNode;
 
+	node->flags = 0;
 	node->left = NULL;
 	node->right = NULL;
 	mem_fence(CLK_GLOBAL_MEM_FENCE);;
@@ -42,9 +46,16 @@ clTree_add(struct clTree __global *tree, struct clTree_node __global *node)
 			return 1;
 		/* else someone beat me to it! Carry on */
 
+		/* Below a leaf that's being unlinked, its parent will drop it
+		 * shortly */
+		if(cNode == CLTREE_POISON) {
+			cursor = (volatile uintptr_t __global *) &(tree->root);
+			continue;
+		}
+
 		cNow = (volatile struct clTree_node __global *) cNode;
 
-		if(cNow->key == node->key)
+		if(cNow->key == node->key && !(cNow->flags & CLTREE_DELETED))
 			return 0;
 		else if(node->key < cNow->key)
 			cursor = (volatile uintptr_t __global *)&(cNow->left);
@@ -55,14 +66,49 @@ clTree_add(struct clTree __global *tree, struct clTree_node __global *node)
 	return 0;
 }
 
+/**
+ * _clTree_get_from() - Look up key in the subtree below cursor
+ */
+struct clTree_node __global *
+_clTree_get_from(volatile struct clTree_node __global *cursor, unsigned int key)
+{
+	while((uintptr_t) cursor > CLTREE_POISON) {
+		if(key == cursor->key && !(cursor->flags & CLTREE_DELETED))
+			return cursor;
+
+		if(key < cursor->key)
+			cursor = cursor->left;
+		else
+			cursor = cursor->right;
+	}
+
+	return NULL;
+}
+
 struct clTree_node __global *
 clTree_get(struct clTree __global *tree, unsigned int key)
+{
+	return _clTree_get_from(tree->root, key);
+}
+
+/**
+ * clTree_delete() - Mark the live node with key as deleted
+ * @return The node, NULL if there was none
+ *
+ * The node stays in the tree to route lookups and adds until clTree_unlink()
+ * removes it, which only happens once it's a leaf.
+ */
+struct clTree_node __global *
+clTree_delete(struct clTree __global *tree, unsigned int key)
 {
 	volatile struct clTree_node __global *cursor = tree->root;
 
-	while(cursor != NULL) {
-		if(key == cursor->key)
-			return cursor;
+	while((uintptr_t) cursor > CLTREE_POISON) {
+		if(key == cursor->key && !(cursor->flags & CLTREE_DELETED)) {
+			if(!(atom_or(&cursor->flags, CLTREE_DELETED) & CLTREE_DELETED))
+				return cursor;
+			/* Lost the race, any newer node with key is on the right */
+		}
 
 		if(key < cursor->key)
 			cursor = cursor->left;
@@ -72,3 +118,401 @@ clTree_get(struct clTree __global *tree, unsigned int key)
 
 	return NULL;
 }
+
+/**
+ * _clTree_unlink_leaf() - Take a deleted leaf out of the tree
+ * @slot: Parent pointer to n
+ * @n: Deleted node
+ * @return 1 if unlinked, 0 if n is not a leaf or someone else has it
+ *
+ * Both children are sealed with CLTREE_POISON first, so no add can hang a
+ * node below n while the parent pointer is cleared. Only the work-item that
+ * set CLTREE_DEAD touches n's children or slot.
+ */
+unsigned int
+_clTree_unlink_leaf(volatile uintptr_t __global *slot,
+		volatile struct clTree_node __global *n)
+{
+	volatile uintptr_t __global *l, *r;
+
+	if(atom_cmpxchg(&n->flags, CLTREE_DELETED,
+			CLTREE_DELETED | CLTREE_DEAD) != CLTREE_DELETED)
+		return 0;
+
+	l = (volatile uintptr_t __global *) &(n->left);
+	r = (volatile uintptr_t __global *) &(n->right);
+	if(atom_cmpxchg(l, NULL, CLTREE_POISON) != NULL) {
+		atom_and(&n->flags, ~CLTREE_DEAD);
+		return 0;
+	}
+	if(atom_cmpxchg(r, NULL, CLTREE_POISON) != NULL) {
+		*l = NULL;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		atom_and(&n->flags, ~CLTREE_DEAD);
+		return 0;
+	}
+
+	atom_cmpxchg(slot, (uintptr_t) n, NULL);
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+	return 1;
+}
+
+/**
+ * clTree_unlink() - Unlink and free deleted leaves with key
+ * @gc: See CLTREE_RETIRE
+ * @return Number of nodes unlinked
+ *
+ * Inner nodes stay until their subtrees are gone, call again after
+ * unlinking their descendants. Lookups may still be reading an unlinked node,
+ * which is why it is retired rather than freed straight away. Its key may be
+ * overwritten then, but with both children sealed that can't lead anyone
+ * astray.
+ */
+unsigned int
+clTree_unlink(struct clTree __global *tree, unsigned int key, void __global *gc)
+{
+	volatile uintptr_t __global *slot;
+	volatile struct clTree_node __global *n;
+	unsigned int removed = 0;
+
+	slot = (volatile uintptr_t __global *) &(tree->root);
+	while(*slot > CLTREE_POISON) {
+		n = (volatile struct clTree_node __global *) *slot;
+
+		if(key == n->key) {
+			/* The live one, nothing to unlink below */
+			if(!(n->flags & CLTREE_DELETED))
+				break;
+
+			if(_clTree_unlink_leaf(slot, n)) {
+				CLTREE_RETIRE(gc, n);
+				removed++;
+				continue;
+			}
+		}
+
+		if(key < n->key)
+			slot = (volatile uintptr_t __global *) &(n->left);
+		else
+			slot = (volatile uintptr_t __global *) &(n->right);
+	}
+
+	return removed;
+}
+
+/**
+ * _clTree_ceil() - Find the node with the smallest key >= k, deleted or not
+ * @return The topmost such node, NULL if all keys are smaller than k
+ */
+struct clTree_node __global *
+_clTree_ceil(struct clTree __global *tree, unsigned int k)
+{
+	volatile struct clTree_node __global *cursor = tree->root, *ret = NULL;
+
+	while((uintptr_t) cursor > CLTREE_POISON) {
+		if(cursor->key >= k) {
+			ret = cursor;
+			cursor = cursor->left;
+		} else {
+			cursor = cursor->right;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * _clTree_scan_flush() - Append a batch of nodes to the list
+ * @return 1 on success, 0 if the list could not grow
+ */
+unsigned int
+_clTree_scan_flush(clArrayList __global *list, uintptr_t *batch,
+		unsigned int count)
+{
+	uintptr_t __global *dst;
+	unsigned int i;
+
+	if(count == 0)
+		return 1;
+
+	dst = (uintptr_t __global *) clArrayList_grow(list, count);
+	if(dst == NULL)
+		return 0;
+
+	for(i = 0; i < count; i++)
+		dst[i] = batch[i];
+
+	return 1;
+}
+
+/**
+ * clTree_scan() - Collect the live nodes with lo <= key <= hi
+ * @list: ArrayList of node pointers, objSize sizeof(uintptr_t)
+ * @return Number of nodes this work-item appended
+ *
+ * The key range is split evenly over the NDRange. Every work-item walks its
+ * share in order by successor search from the root, and appends nodes in
+ * batches of CLTREE_SCAN_BATCH, so the nodes of each batch are consecutive
+ * and sorted. Batches of different work-items interleave.
+ */
+unsigned int
+clTree_scan(struct clTree __global *tree, unsigned int lo, unsigned int hi,
+		clArrayList __global *list)
+{
+	uintptr_t batch[CLTREE_SCAN_BATCH];
+	struct clTree_node __global *node;
+	size_t pid = 0, gsize, i;
+	ulong span, first, last;
+	unsigned int k, key, count = 0, total = 0;
+
+	for(i = 0, gsize = 1; i < get_work_dim(); i++) {
+		pid += gsize * get_global_id(i);
+		gsize *= get_global_size(i);
+	}
+
+	if(hi < lo)
+		return 0;
+
+	span = ((ulong) hi - lo) / gsize + 1;
+	if(pid * span > (ulong) hi - lo)
+		return 0;
+	first = lo + pid * span;
+	last = min(first + span - 1, (ulong) hi);
+
+	k = (unsigned int) first;
+	while((node = _clTree_ceil(tree, k)) != NULL) {
+		key = node->key;
+		if(key > last)
+			break;
+
+		/* A deleted node may have a live successor with the same key */
+		if(node->flags & CLTREE_DELETED)
+			node = _clTree_get_from(node->right, key);
+		if(node) {
+			batch[count++] = (uintptr_t) node;
+			if(count == CLTREE_SCAN_BATCH) {
+				if(!_clTree_scan_flush(list, batch, count))
+					return total;
+				total += count;
+				count = 0;
+			}
+		}
+
+		if(key == last)
+			break;
+		k = key + 1;
+	}
+
+	if(!_clTree_scan_flush(list, batch, count))
+		return total;
+
+	return total + count;
+}
+
+/**
+ * clTree_cache_load() - Copy the top levels of a tree to local memory
+ * @tree: Tree, not modified while the cache is in use
+ * @keys: Scratch, (1 << levels) - 1 keys
+ * @nodes: Scratch, (2 << levels) - 1 pointers
+ * @levels: Number of levels to cache
+ *
+ * All work-items in the work-group must call this. Levels are stored
+ * breadth-first as an implicit heap: the children of entry i are 2i + 1 and
+ * 2i + 2. nodes has one more level than keys, the frontier at which
+ * lookups continue in global memory. Absent nodes are NULL or
+ * CLTREE_POISON.
+ */
+void
+clTree_cache_load(struct clTree __global *tree, unsigned int __local *keys,
+		uintptr_t __local *nodes, unsigned int levels)
+{
+	volatile struct clTree_node __global *n;
+	size_t lid = 0, lsize, i, first;
+	unsigned int l;
+
+	for(i = 0, lsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+
+	if(lid == 0)
+		nodes[0] = (uintptr_t) tree->root;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for(l = 0; l < levels; l++) {
+		first = (1 << l) - 1;
+		for(i = first + lid; i < (first << 1) + 1; i += lsize) {
+			n = (volatile struct clTree_node __global *) nodes[i];
+			if((uintptr_t) n > CLTREE_POISON) {
+				keys[i] = n->key;
+				nodes[(i << 1) + 1] = (uintptr_t) n->left;
+				nodes[(i << 1) + 2] = (uintptr_t) n->right;
+			} else {
+				nodes[(i << 1) + 1] = NULL;
+				nodes[(i << 1) + 2] = NULL;
+			}
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+}
+
+/**
+ * clTree_get_cached() - clTree_get through a cache from clTree_cache_load
+ * @keys: Cached keys
+ * @nodes: Cached nodes
+ * @levels: Number of levels cached
+ */
+struct clTree_node __global *
+clTree_get_cached(unsigned int key, unsigned int __local *keys,
+		uintptr_t __local *nodes, unsigned int levels)
+{
+	size_t i = 0, end = (1 << levels) - 1;
+
+	while(i < end) {
+		if(nodes[i] <= CLTREE_POISON)
+			return NULL;
+		if(key == keys[i] && !(((struct clTree_node __global *)
+				nodes[i])->flags & CLTREE_DELETED))
+			return (struct clTree_node __global *) nodes[i];
+
+		i = (i << 1) + ((key < keys[i]) ? 1 : 2);
+	}
+
+	return _clTree_get_from((volatile struct clTree_node __global *)
+			nodes[i], key);
+}
+
+/**
+ * clTree_sort_local() - Bitonic sort of (key, index) pairs as a work-group
+ * @sort: Pairs, ties are broken on index
+ * @n: Number of pairs, a power of two
+ *
+ * All work-items in the work-group must call this, with sort filled in and
+ * visible to all.
+ */
+void
+clTree_sort_local(uint2 __local *sort, size_t n)
+{
+	size_t lid = 0, lsize, i, j, k, ixj;
+	uint2 a, b;
+
+	for(i = 0, lsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+
+	for(k = 2; k <= n; k <<= 1) {
+		for(j = k >> 1; j > 0; j >>= 1) {
+			for(i = lid; i < n; i += lsize) {
+				ixj = i ^ j;
+				if(ixj <= i)
+					continue;
+				a = sort[i];
+				b = sort[ixj];
+				if((a.x > b.x || (a.x == b.x && a.y > b.y)) ==
+						((i & k) == 0)) {
+					sort[i] = b;
+					sort[ixj] = a;
+				}
+			}
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+	}
+}
+
+/**
+ * clTree_get_many() - Look up one key per work-item, as a work-group
+ * @tree: Tree
+ * @key: This work-item's key, 0xffffffff to look up nothing
+ * @sort: Scratch, one uint2 per work-item rounded up to a power of two
+ * @res: Scratch, one pointer per work-item
+ * @return Node for key, NULL if not present
+ *
+ * All work-items in the work-group must call this. Keys are bitonic sorted
+ * first, so neighbouring lanes walk down the same path and take the same
+ * branches for as long as possible.
+ */
+struct clTree_node __global *
+clTree_get_many(struct clTree __global *tree, unsigned int key,
+		uint2 __local *sort, uintptr_t __local *res)
+{
+	size_t lid = 0, lsize, n, i;
+	uint2 a;
+
+	for(i = 0, lsize = 1; i < get_work_dim(); i++) {
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+	for(n = 1; n < lsize; n <<= 1);
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for(i = lid; i < n; i += lsize) {
+		sort[i].x = (i == lid) ? key : 0xffffffff;
+		sort[i].y = i;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	clTree_sort_local(sort, n);
+
+	/* Padding sorts last, ties are broken on index, so the first lsize
+	 * entries are all real */
+	a = sort[lid];
+	res[a.y] = (a.x == 0xffffffff) ? NULL :
+			(uintptr_t) clTree_get(tree, a.x);
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	return (struct clTree_node __global *) res[lid];
+}
+
+/**
+ * clTree_build_balanced() - Build a balanced tree from sorted unique keys
+ * @tree: Empty tree
+ * @keys: n keys, sorted ascending without duplicates
+ * @nodes: n nodes, node i is placed at nodes + i * stride and gets key i
+ * @stride: Size of the structure embedding each clTree_node at offset 0
+ *
+ * Every key becomes the midpoint of the range it splits, so each work-item
+ * can work out the children of its own node by bisecting [0, n) down to it
+ * without any coordination. No atomics, the resulting tree is as deep as
+ * ceil(log2(n + 1)). Nodes of work-items >= n are left untouched.
+ */
+void
+clTree_build_balanced(struct clTree __global *tree,
+		unsigned int __global *keys, unsigned int n,
+		char __global *nodes, size_t stride)
+{
+	struct clTree_node __global *node;
+	size_t pid = 0, gsize, i, j;
+	unsigned int lo, hi, mid;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+	gsize = j;
+
+	for(i = pid; i < n; i += gsize) {
+		lo = 0;
+		hi = n;
+		mid = n / 2;
+		while(mid != i) {
+			if(i < mid)
+				hi = mid;
+			else
+				lo = mid + 1;
+			mid = lo + (hi - lo) / 2;
+		}
+
+		node = (struct clTree_node __global *) (nodes + i * stride);
+		node->key = keys[i];
+		node->flags = 0;
+		node->left = (lo < mid) ? (struct clTree_node __global *)
+				(nodes + (lo + (mid - lo) / 2) * stride) : NULL;
+		node->right = (mid + 1 < hi) ? (struct clTree_node __global *)
+				(nodes + (mid + 1 + (hi - mid - 1) / 2) * stride) : NULL;
+
+		if(i == n / 2)
+			tree->root = node;
+	}
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+}
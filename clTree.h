@@ -21,8 +21,31 @@
 #ifndef CLTREE_H
 #define CLTREE_H
 
+#include "clArrayList.h"
+
+#define CLTREE_CACHE_LEVELS 8	/**< Levels cached by clTree_cache_load */
+#define CLTREE_SCAN_BATCH 16	/**< Nodes clTree_scan appends at once */
+
+/* Node flags */
+#define CLTREE_DELETED 1	/**< Logically deleted, the key still routes */
+#define CLTREE_DEAD 2		/**< Being unlinked */
+
+/* Child pointer of a leaf sealed for unlinking. Treat it as NULL when
+ * reading, restart from the root when trying to add below it. */
+#define CLTREE_POISON ((uintptr_t) 1)
+
+/* Return an unlinked node to the heap. With KMA, gc is the
+ * struct kma_epoch the calling work-group entered. */
+#ifdef KMA_H
+#define CLTREE_RETIRE(gc, n) kma_free_deferred((struct kma_epoch __global *) (gc), \
+		(uintptr_t) (n))
+#else
+#define CLTREE_RETIRE(gc, n)
+#endif
+
 struct clTree_node{
 	unsigned int key;
+	volatile unsigned int flags;
 	volatile struct clTree_node __global *left;
 	volatile struct clTree_node __global *right;
 };
@@ -33,5 +56,20 @@ struct clTree {
 
 unsigned int clTree_add(struct clTree __global *, struct clTree_node __global *);
 struct clTree_node __global *clTree_get(struct clTree __global *, unsigned int);
+void clTree_cache_load(struct clTree __global *, unsigned int __local *,
+		uintptr_t __local *, unsigned int);
+struct clTree_node __global *clTree_get_cached(unsigned int,
+		unsigned int __local *, uintptr_t __local *, unsigned int);
+void clTree_sort_local(uint2 __local *, size_t);
+struct clTree_node __global *clTree_get_many(struct clTree __global *,
+		unsigned int, uint2 __local *, uintptr_t __local *);
+struct clTree_node __global *clTree_delete(struct clTree __global *,
+		unsigned int);
+unsigned int clTree_unlink(struct clTree __global *, unsigned int,
+		void __global *);
+unsigned int clTree_scan(struct clTree __global *, unsigned int, unsigned int,
+		clArrayList __global *);
+void clTree_build_balanced(struct clTree __global *, unsigned int __global *,
+		unsigned int, char __global *, size_t);
 
 #endif /* CLTREE_H */
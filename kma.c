@@ -125,3 +125,88 @@ kma_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
 
 	return q;
 }
+
+cl_mem
+kma_epoch_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem heap, cl_uint groups)
+{
+	cl_int error;
+	cl_uint bits;
+	cl_mem ep;
+	cl_kernel kernel;
+	size_t bytes, threads = groups;
+
+	if(groups == 0)
+		return NULL;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("KMA: could not discover device address space\n");
+		return NULL;
+	}
+
+	if(bits == 32)
+		bytes = sizeof(struct kma_epoch_32);
+	else
+		bytes = sizeof(struct kma_epoch_64);
+	bytes += groups * sizeof(struct kma_epoch_group);
+
+	ep = clCreateBuffer(ctx, CL_MEM_READ_WRITE, bytes, NULL, &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA: Could not allocate epoch administration on-device\n");
+		return NULL;
+	}
+
+	/* Initialise kernel, one work-item per work-group record */
+	kernel = clCreateKernel(prg, "kma_epoch_init", &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA: Could not create epoch init kernel: %i\n", error);
+		return NULL;
+	}
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &ep);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &heap);
+	clSetKernelArg(kernel, 2, sizeof(cl_uint), &groups);
+
+	error = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &threads, NULL, 0, NULL, NULL);
+	error |= clFinish(cq);
+	if (error != CL_SUCCESS) {
+		printf("KMA: Could not execute epoch init kernel: %i\n", error);
+		return NULL;
+	}
+	clReleaseKernel(kernel);
+
+	return ep;
+}
+
+/* 1 if a launch had more work-groups than ep has records, 0 if not, -1 on
+ * error */
+int
+kma_epoch_overflowed(cl_device_id dev, cl_command_queue cq, cl_mem ep)
+{
+	cl_int error;
+	cl_uint bits;
+	union {
+		struct kma_epoch_32 e32;
+		struct kma_epoch_64 e64;
+	} back;
+
+	error = clGetDeviceInfo(dev, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+				&bits, NULL);
+	if(error) {
+		printf("KMA: could not discover device address space\n");
+		return -1;
+	}
+
+	error = clEnqueueReadBuffer(cq, ep, CL_TRUE, 0, bits == 32 ?
+			sizeof(struct kma_epoch_32) : sizeof(struct kma_epoch_64),
+			&back, 0, NULL, NULL);
+	if(error != CL_SUCCESS) {
+		printf("KMA: Could not read epoch administration: %i\n", error);
+		return -1;
+	}
+
+	if(bits == 32)
+		return back.e32.overflow ? 1 : 0;
+	return back.e64.overflow ? 1 : 0;
+}
@@ -372,6 +372,227 @@ free(__global struct clheap *heap, uintptr_t block)
 	}
 }
 
+/******************************
+ * Deferred free
+ *****************************/
+
+/** Initialise epoch administration for deferred free
+ * @param epoch Epoch administration, followed by groups records
+ * @param hp Heap that retired blocks are returned to
+ * @param groups Number of work-group records
+ */
+__kernel void
+kma_epoch_init(void __global *epoch, void __global *hp, unsigned int groups)
+{
+	struct kma_epoch __global *ep = (struct kma_epoch __global *) epoch;
+	struct kma_epoch_group __global *rec;
+	size_t pid = 0, j;
+	unsigned int i, l;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	if(pid == 0) {
+		ep->heap = (struct clheap __global *) hp;
+		ep->epoch = 0;
+		ep->groups = groups;
+		ep->overflow = 0;
+	}
+
+	rec = (struct kma_epoch_group __global *)(ep + 1);
+	for(i = pid; i < groups; i += j) {
+		rec[i].state = 0;
+		for(l = 0; l < KMA_EPOCH_LISTS; l++) {
+			rec[i].retired[l] = 0;
+			rec[i].list_epoch[l] = 0;
+		}
+	}
+}
+
+/* Return the epoch record of the calling work-group, NULL if the launch has
+ * more work-groups than there are records */
+struct kma_epoch_group __global *
+_kma_epoch_group(struct kma_epoch __global *ep)
+{
+	struct kma_epoch_group __global *rec;
+	size_t gid = 0, j;
+	unsigned int i;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		gid += j * get_group_id(i);
+		j *= get_num_groups(i);
+	}
+
+	if(gid >= ep->groups)
+		return NULL;
+
+	rec = (struct kma_epoch_group __global *)(ep + 1);
+	return &rec[gid];
+}
+
+/* Is the calling work-item the first of its work-group? */
+bool
+_kma_epoch_leader(void)
+{
+	return get_local_id(0) == 0 && get_local_id(1) == 0 &&
+			get_local_id(2) == 0;
+}
+
+/* Free all blocks on a detached retire list */
+void
+_kma_epoch_free_list(struct kma_epoch __global *ep, unsigned int off)
+{
+	char __global *base = (char __global *) ep->heap;
+	unsigned int next;
+
+	while(off) {
+		next = *(volatile unsigned int __global *) &base[off];
+		free(ep->heap, (uintptr_t) &base[off]);
+		off = next;
+	}
+}
+
+/**
+ * kma_epoch_enter() - Announce the calling work-group as active
+ * @ep: Epoch administration
+ *
+ * Must be called by all work-items of a work-group before touching shared
+ * structures whose nodes are released with kma_free_deferred(). Frees the
+ * blocks this work-group retired at least two epochs ago and moves the global
+ * epoch forward if every active work-group has caught up with it.
+ *
+ * A work-group without a record can not announce itself. It raises
+ * ep->overflow instead, which stops the epoch for good so that no block is
+ * ever freed underneath it.
+ */
+void
+kma_epoch_enter(struct kma_epoch __global *ep)
+{
+	volatile struct kma_epoch_group __global *rec, *grp;
+	unsigned int e, g, l, state;
+	bool advance = true;
+
+	barrier(CLK_GLOBAL_MEM_FENCE);
+	rec = _kma_epoch_leader() ? _kma_epoch_group(ep) : NULL;
+	if(_kma_epoch_leader() && rec == NULL) {
+		atom_xchg(&ep->overflow, 1);
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	} else if(rec) {
+		/* Announce, retry if the epoch moved underneath me */
+		do {
+			e = ep->epoch;
+			rec->state = (e << 1) | 1;
+			mem_fence(CLK_GLOBAL_MEM_FENCE);
+		} while(ep->epoch != e);
+
+		grp = (volatile struct kma_epoch_group __global *)(ep + 1);
+		if(ep->overflow)
+			advance = false;
+		for(g = 0; g < ep->groups && advance; g++) {
+			state = grp[g].state;
+			if((state & 1) && (state >> 1) != e)
+				advance = false;
+		}
+		if(advance && atom_cmpxchg(&ep->epoch, e, e + 1) == e)
+			e++;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		/* Blocks retired in epoch r are unreachable once the global
+		 * epoch reaches r + 2 */
+		for(l = 0; l < KMA_EPOCH_LISTS; l++) {
+			if(rec->retired[l] && rec->list_epoch[l] + 2 <= e)
+				_kma_epoch_free_list(ep,
+					atom_xchg(&rec->retired[l], 0));
+		}
+	}
+	barrier(CLK_GLOBAL_MEM_FENCE);
+}
+
+/**
+ * kma_epoch_exit() - Mark the calling work-group inactive
+ * @ep: Epoch administration
+ *
+ * Work-group collective counterpart of kma_epoch_enter(). Retired blocks
+ * stay on the work-group's lists until the next kma_epoch_enter() or
+ * kma_epoch_flush().
+ */
+void
+kma_epoch_exit(struct kma_epoch __global *ep)
+{
+	volatile struct kma_epoch_group __global *rec;
+
+	barrier(CLK_GLOBAL_MEM_FENCE);
+	if(_kma_epoch_leader()) {
+		rec = _kma_epoch_group(ep);
+		if(rec)
+			rec->state = 0;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	}
+}
+
+/**
+ * kma_free_deferred() - Free a block once no work-group can reference it
+ * @ep: Epoch administration
+ * @block: Block to free, already unlinked from any shared structure
+ *
+ * Only valid between kma_epoch_enter() and kma_epoch_exit(). A work-group
+ * without a record has nowhere to retire the block to and leaks it.
+ */
+void
+kma_free_deferred(struct kma_epoch __global *ep, uintptr_t block)
+{
+	struct kma_epoch_group __global *rec;
+	volatile unsigned int __global *link;
+	unsigned int e, l, off, head;
+
+	if(block == NULL)
+		return;
+
+	rec = _kma_epoch_group(ep);
+	if(rec == NULL)
+		return;
+
+	link = (volatile unsigned int __global *) block;
+	off = block - (uintptr_t) ep->heap;
+
+	/* Tag with the global epoch after unlinking, not my announced one */
+	e = ep->epoch;
+	l = e % KMA_EPOCH_LISTS;
+	atom_max(&rec->list_epoch[l], e);
+
+	do {
+		head = rec->retired[l];
+		*link = head;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+	} while(atom_cmpxchg(&rec->retired[l], head, off) != head);
+}
+
+/** Free all retired blocks
+ * @param epoch Epoch administration
+ * Only safe when no kernel is using the structures retired blocks came from.
+ */
+__kernel void
+kma_epoch_flush(void __global *epoch)
+{
+	struct kma_epoch __global *ep = (struct kma_epoch __global *) epoch;
+	struct kma_epoch_group __global *rec;
+	size_t pid = 0, j;
+	unsigned int i, l;
+
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	rec = (struct kma_epoch_group __global *)(ep + 1);
+	for(i = pid; i < ep->groups; i += j) {
+		for(l = 0; l < KMA_EPOCH_LISTS; l++)
+			_kma_epoch_free_list(ep, atom_xchg(&rec[i].retired[l], 0));
+	}
+}
+
 /******************************
  * Tests
  *****************************/
@@ -525,6 +746,54 @@ kma_test_malloc_highvar(struct clheap __global *heap, unsigned int iters)
 	}
 }
 
+__kernel void
+kma_test_free_deferred(struct clheap __global *heap, void __global *epoch,
+		unsigned int iters)
+{
+	struct kma_epoch __global *ep = (struct kma_epoch __global *) epoch;
+	size_t pid = 0, j;
+	unsigned int i;
+	volatile size_t __global *block;
+
+	/* First find global unique ID */
+	for(i = 0, j = 1; i < get_work_dim(); i++) {
+		pid += j * get_global_id(i);
+		j *= get_global_size(i);
+	}
+
+	/* Enter and exit are collective, keep every work-item in the loop */
+	for(i = 0; i < iters; i++) {
+		kma_epoch_enter(ep);
+		block = (size_t __global *)malloc(heap, sizeof(size_t));
+		if(block) {
+			block[0] = pid;
+			kma_free_deferred(ep, (uintptr_t) block);
+		}
+		kma_epoch_exit(ep);
+	}
+}
+
+/* Count the superblocks on the free list, including the dummy head.
+ * out[0] receives the count, out[1] the number of superblocks in the heap.
+ * Run with a single work-item on a quiescent heap. */
+__kernel void
+kma_test_count_free(struct clheap __global *heap, unsigned int __global *out)
+{
+	clIndexedQueue_item __global *item;
+	unsigned int count = 0;
+
+	item = (clIndexedQueue_item __global *)
+			clIndexedQueue_idx2ptr(&heap->free, heap->free.head);
+	while(item) {
+		count++;
+		item = (clIndexedQueue_item __global *)
+				clIndexedQueue_idx2ptr(&heap->free, item->next);
+	}
+
+	out[0] = count;
+	out[1] = (heap->bytes >> KMA_SB_SIZE_LOG2) - 1;
+}
+
 /* Only for OpenCL 1.2+ */
 //#if !(CL_PLATFORM==2)
 //__kernel void
@@ -27,6 +27,15 @@
 #define KMA_SB_SIZE 4096	/**< Superblock size: 4KB */
 #define KMA_SB_SIZE_LOG2 12	/**< Log 2 of superblock size: 2^12=4K */
 #define KMA_SB_SIZE_BUCKETS KMA_SB_SIZE_LOG2 - 1 /**< Size buckets */
+#define KMA_EPOCH_LISTS 3	/**< Retire lists per work-group */
+
+/* Per work-group record for deferred free. Retired blocks are chained
+ * through their first word, as 32-bit offsets relative to the heap. */
+struct kma_epoch_group {
+	volatile uint32_t state;			/**< Epoch << 1 | active */
+	volatile uint32_t retired[KMA_EPOCH_LISTS];	/**< Retire list heads */
+	volatile uint32_t list_epoch[KMA_EPOCH_LISTS];	/**< Newest epoch per list */
+};
 
 #ifdef __OPENCL_CL_H
 typedef volatile uintptr_t vg_uptr_t;
@@ -45,8 +54,27 @@ struct kma_heap_64 {
 	uint64_t sb[KMA_SB_SIZE_BUCKETS];	/**< SB hashtbl*/
 };
 
+/* Followed by groups * struct kma_epoch_group */
+struct kma_epoch_32 {
+	uint32_t heap;
+	uint32_t epoch;
+	uint32_t groups;
+	uint32_t overflow;
+};
+
+struct kma_epoch_64 {
+	uint64_t heap;
+	uint32_t epoch;
+	uint32_t groups;
+	uint32_t overflow;
+};
+
 extern cl_mem kma_create(cl_device_id dev, cl_context ctx, cl_command_queue cq,
 		cl_program prg, unsigned int);
+extern cl_mem kma_epoch_create(cl_device_id dev, cl_context ctx,
+		cl_command_queue cq, cl_program prg, cl_mem heap, cl_uint groups);
+extern int kma_epoch_overflowed(cl_device_id dev, cl_command_queue cq,
+		cl_mem ep);
 int clheap_execute(cl_device_id, cl_context, cl_command_queue,cl_program,
 		size_t);
 #else
@@ -83,5 +111,18 @@ struct clheap {
 	clIndexedQueue free;				 	 /**< Free list */
 	volatile struct kma_sb __global *sb[KMA_SB_SIZE_BUCKETS]; /**< SB hashtbl*/
 };
+
+/* Epoch administration for deferred free, followed by one
+ * struct kma_epoch_group per work-group */
+struct kma_epoch {
+	struct clheap __global *heap;
+	volatile unsigned int epoch;	/**< Global epoch */
+	unsigned int groups;		/**< Number of group records */
+	volatile unsigned int overflow;	/**< A work-group found no record */
+};
+
+void kma_epoch_enter(struct kma_epoch __global *);
+void kma_epoch_exit(struct kma_epoch __global *);
+void kma_free_deferred(struct kma_epoch __global *, uintptr_t);
 #endif
 #endif
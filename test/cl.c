@@ -27,6 +27,7 @@
 #include <unistd.h>
 
 #include "test/cl.h"
+#include "test/timing.h"
 
 struct opts options;
 
@@ -229,7 +230,7 @@ int
 options_read(unsigned int argc, char **argv,
 		int (*opt_process)(unsigned int, unsigned int, char **))
 {
-	unsigned int i;
+	unsigned int i, runs;
 	int ret;
 	size_t3 tSingle;
 
@@ -274,6 +275,31 @@ options_read(unsigned int argc, char **argv,
 				printf("Error: -T requires a file name\n\n");
 				return -1;
 			}
+		} else if(strncmp(argv[i], "-w", 2) == 0) {
+			i++;
+			if(i < argc && sscanf(argv[i], "%u", &runs) == 1) {
+				tWarmup = runs;
+			} else {
+				printf("Error: -w requires a number of runs\n\n");
+				return -1;
+			}
+		} else if(strncmp(argv[i], "-s", 2) == 0) {
+			i++;
+			if(i < argc && sscanf(argv[i], "%u", &runs) == 1 &&
+					runs > 0) {
+				tSamples = runs;
+			} else {
+				printf("Error: -s requires a number of runs\n\n");
+				return -1;
+			}
+		} else if(strncmp(argv[i], "-o", 2) == 0) {
+			i++;
+			if(i >= argc) {
+				printf("Error: -o requires a file name\n\n");
+				return -1;
+			}
+			if(tOutput(argv[i]))
+				return -1;
 		} else {
 			ret = -1;
 			if(opt_process)
@@ -299,6 +325,10 @@ options_print()
 	printf("\t-g:\t\tCompile kernel with debug symbols (if available)\n");
 	printf("\t-t x,y,z:\tProvide a single thread-configuration\n\n");
 	printf("\t-T [file]:\tProvide a file with thread-configurations\n");
+	printf("\t-w n:\t\tWarm-up runs before measuring, default 0\n");
+	printf("\t-s n:\t\tMeasured runs, default 1\n");
+	printf("\t-o [file]:\tAppend timing records to file, JSON lines if it"
+			" ends in .json,\n\t\t\tCSV otherwise\n");
 	printf("Thread configuration files are {x, y, z} tuples, always in 3"
 			" dimensions.\n");
 	printf("The first line contains the amount of tuples. If no argument"
@@ -356,7 +386,8 @@ clSetup(cl_platform_id *pid, cl_device_id *cid, cl_context *ctx,
 		return -1;
 	}
 
-	*cq = clCreateCommandQueue(*ctx, *cid, 0, &err);
+	/* Kernel times come from event timestamps */
+	*cq = clCreateCommandQueue(*ctx, *cid, CL_QUEUE_PROFILING_ENABLE, &err);
 	if (!*cq) {
 		printf("Error: Could not create command queue\n");
 		return -1;
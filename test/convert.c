@@ -0,0 +1,78 @@
+/**
+ * convert.c
+ * Convert edge list datasets between the binary, text and SNAP formats
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dataset.h"
+
+void
+usage()
+{
+	printf("Usage: convert [-f bin|text|snap] [-t threads] <in> <out>\n");
+	printf("Reads any format, writes the binary format unless told otherwise.\n");
+	printf("-t sets the number of text parser threads, default one per CPU.\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct dataset ds;
+	int i, format = DATASET_BINARY;
+	unsigned int threads = 0;
+	char *in = NULL, *out = NULL;
+
+	for(i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-f") && i + 1 < argc) {
+			format = dataset_format(argv[++i]);
+			if(format < 0) {
+				usage();
+				return -1;
+			}
+		} else if(!strcmp(argv[i], "-t") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if(!in) {
+			in = argv[i];
+		} else if(!out) {
+			out = argv[i];
+		} else {
+			usage();
+			return -1;
+		}
+	}
+
+	if(!in || !out) {
+		usage();
+		return -1;
+	}
+
+	if(dataset_read(in, &ds, threads))
+		return -1;
+	printf("%s: %lu links\n", in, (unsigned long) ds.count);
+
+	if(dataset_write(out, &ds, format)) {
+		dataset_free(&ds);
+		return -1;
+	}
+
+	dataset_free(&ds);
+	return 0;
+}
@@ -0,0 +1,333 @@
+/**
+ * dataset.c
+ * Edge list datasets: binary, text and SNAP formats
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dataset.h"
+
+/* Part of a text file, parsed by one thread */
+struct _dataset_chunk {
+	const char *start, *end;
+	uint32_t *links;
+	size_t count, size;
+	int error;
+};
+
+/**
+ * _dataset_parse() - Parse the edges in a chunk of text
+ *
+ * Every line holding at least two numbers is an edge, anything but digits
+ * separates them, so both {source,sink} and SNAP's "source<tab>sink" work.
+ * Lines with a single number (the count heading the text format) and lines
+ * starting with # or % are skipped.
+ */
+static void *
+_dataset_parse(void *arg)
+{
+	struct _dataset_chunk *c = (struct _dataset_chunk *) arg;
+	const char *p = c->start;
+	uint32_t *grow, v[2];
+	unsigned int nums;
+	uint64_t val;
+
+	c->size = ((c->end - c->start) / 8) + 16;
+	c->links = malloc(c->size * 2 * sizeof(uint32_t));
+	c->count = 0;
+	if(!c->links) {
+		c->error = -1;
+		return NULL;
+	}
+
+	while(p < c->end) {
+		while(p < c->end && (*p == ' ' || *p == '\t'))
+			p++;
+		if(p < c->end && (*p == '#' || *p == '%')) {
+			while(p < c->end && *p != '\n')
+				p++;
+		}
+
+		nums = 0;
+		while(p < c->end && *p != '\n') {
+			if(*p < '0' || *p > '9') {
+				p++;
+				continue;
+			}
+
+			for(val = 0; p < c->end && *p >= '0' && *p <= '9'; p++)
+				val = val * 10 + (*p - '0');
+			if(val > UINT32_MAX) {
+				c->error = -1;
+				return NULL;
+			}
+			if(nums < 2)
+				v[nums] = val;
+			nums++;
+		}
+		p++;
+
+		if(nums < 2)
+			continue;
+
+		if(c->count == c->size) {
+			c->size <<= 1;
+			grow = realloc(c->links, c->size * 2 * sizeof(uint32_t));
+			if(!grow) {
+				c->error = -1;
+				return NULL;
+			}
+			c->links = grow;
+		}
+		c->links[c->count << 1] = v[0];
+		c->links[(c->count << 1) + 1] = v[1];
+		c->count++;
+	}
+
+	return NULL;
+}
+
+/* Parse a text file with threads threads, chunks split at line ends */
+static int
+_dataset_read_text(const char *buf, size_t size, struct dataset *ds,
+		unsigned int threads)
+{
+	struct _dataset_chunk *c;
+	pthread_t *tid;
+	unsigned int t;
+	size_t off;
+	int ret = 0;
+
+	c = calloc(threads, sizeof(struct _dataset_chunk));
+	tid = calloc(threads, sizeof(pthread_t));
+	if(!c || !tid)
+		return -1;
+
+	for(t = 0; t < threads; t++) {
+		if(t == 0) {
+			c[t].start = buf;
+		} else {
+			off = (size / threads) * t;
+			if(buf + off < c[t - 1].start)
+				off = c[t - 1].start - buf;
+			while(off > 0 && off < size && buf[off - 1] != '\n')
+				off++;
+			c[t].start = buf + off;
+		}
+		if(t > 0)
+			c[t - 1].end = c[t].start;
+	}
+	c[threads - 1].end = buf + size;
+
+	for(t = 0; t < threads; t++) {
+		if(pthread_create(&tid[t], NULL, _dataset_parse, &c[t])) {
+			c[t].error = -1;
+			tid[t] = 0;
+		}
+	}
+
+	ds->count = 0;
+	for(t = 0; t < threads; t++) {
+		if(tid[t])
+			pthread_join(tid[t], NULL);
+		if(c[t].error)
+			ret = -1;
+		ds->count += c[t].count;
+	}
+
+	ds->links = NULL;
+	if(ret == 0)
+		ds->links = malloc((ds->count ? ds->count : 1) * 2 * sizeof(uint32_t));
+	if(!ds->links)
+		ret = -1;
+
+	for(t = 0, off = 0; t < threads; t++) {
+		if(ret == 0) {
+			memcpy(&ds->links[off << 1], c[t].links,
+					c[t].count * 2 * sizeof(uint32_t));
+			off += c[t].count;
+		}
+		free(c[t].links);
+	}
+
+	free(tid);
+	free(c);
+	return ret;
+}
+
+/**
+ * dataset_read() - Read an edge list
+ * @path: File, any of the DATASET_* formats
+ * @ds: Return value for the dataset
+ * @threads: Parser threads for text, 0 for one per CPU
+ * @return 0 on success, -1 on failure
+ *
+ * The binary format is mapped and used in place, nothing is copied until the
+ * links are uploaded.
+ */
+int
+dataset_read(const char *path, struct dataset *ds, unsigned int threads)
+{
+	struct dataset_header *hdr;
+	struct stat st;
+	char *buf;
+	int fd, ret;
+
+	memset(ds, 0, sizeof(struct dataset));
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		printf("Dataset: cannot open %s\n", path);
+		return -1;
+	}
+	if(fstat(fd, &st) < 0 || st.st_size == 0) {
+		printf("Dataset: %s is empty\n", path);
+		close(fd);
+		return -1;
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(buf == MAP_FAILED) {
+		printf("Dataset: cannot map %s\n", path);
+		return -1;
+	}
+
+	hdr = (struct dataset_header *) buf;
+	if(st.st_size >= sizeof(struct dataset_header) &&
+			hdr->magic == DATASET_MAGIC) {
+		if(hdr->version != DATASET_VERSION ||
+				(st.st_size - sizeof(struct dataset_header)) / 8 <
+				hdr->count) {
+			printf("Dataset: %s is malformed\n", path);
+			munmap(buf, st.st_size);
+			return -1;
+		}
+
+		madvise(buf, st.st_size, MADV_SEQUENTIAL);
+		ds->links = (uint32_t *) (hdr + 1);
+		ds->count = hdr->count;
+		ds->map = buf;
+		ds->mapSize = st.st_size;
+		return 0;
+	}
+
+	if(threads == 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads < 1)
+		threads = 1;
+	/* Keep chunks worth a thread */
+	if(threads > st.st_size / 65536 + 1)
+		threads = st.st_size / 65536 + 1;
+
+	ret = _dataset_read_text(buf, st.st_size, ds, threads);
+	munmap(buf, st.st_size);
+	if(ret)
+		printf("Dataset: %s is malformed\n", path);
+
+	return ret;
+}
+
+/**
+ * dataset_write() - Write an edge list
+ * @format: One of DATASET_*
+ * @return 0 on success, -1 on failure
+ */
+int
+dataset_write(const char *path, struct dataset *ds, int format)
+{
+	struct dataset_header hdr;
+	uint64_t i;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(path, "w");
+	if(!fp) {
+		printf("Dataset: cannot open %s for writing\n", path);
+		return -1;
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	switch(format) {
+	case DATASET_BINARY:
+		hdr.magic = DATASET_MAGIC;
+		hdr.version = DATASET_VERSION;
+		hdr.count = ds->count;
+		if(fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+				fwrite(ds->links, 2 * sizeof(uint32_t), ds->count,
+				fp) != ds->count)
+			ret = -1;
+		break;
+	case DATASET_TEXT:
+		fprintf(fp, "%lu\n", (unsigned long) ds->count);
+		for(i = 0; i < ds->count; i++)
+			fprintf(fp, "{%u,%u}\n", ds->links[i << 1],
+					ds->links[(i << 1) + 1]);
+		break;
+	case DATASET_SNAP:
+		fprintf(fp, "# Edges: %lu\n", (unsigned long) ds->count);
+		for(i = 0; i < ds->count; i++)
+			fprintf(fp, "%u\t%u\n", ds->links[i << 1],
+					ds->links[(i << 1) + 1]);
+		break;
+	default:
+		ret = -1;
+		break;
+	}
+
+	if(ferror(fp))
+		ret = -1;
+	if(fclose(fp))
+		ret = -1;
+	if(ret)
+		printf("Dataset: failed to write %s\n", path);
+
+	return ret;
+}
+
+void
+dataset_free(struct dataset *ds)
+{
+	if(ds->map)
+		munmap(ds->map, ds->mapSize);
+	else
+		free(ds->links);
+
+	memset(ds, 0, sizeof(struct dataset));
+}
+
+/* DATASET_* for a format name, -1 if unknown */
+int
+dataset_format(const char *name)
+{
+	if(!strcmp(name, "bin"))
+		return DATASET_BINARY;
+	if(!strcmp(name, "text"))
+		return DATASET_TEXT;
+	if(!strcmp(name, "snap"))
+		return DATASET_SNAP;
+
+	return -1;
+}
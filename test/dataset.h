@@ -0,0 +1,54 @@
+/**
+ * dataset.h
+ * Edge list datasets: binary, text and SNAP formats
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DATASET_MAGIC 0x4b4d4145	/**< "EAMK" on disk, little endian */
+#define DATASET_VERSION 1
+
+/* File formats */
+#define DATASET_BINARY 0	/**< struct dataset_header, then the pairs */
+#define DATASET_TEXT 1		/**< Count, then one {source,sink} per line */
+#define DATASET_SNAP 2		/**< One "source sink" per line, # comments */
+
+struct dataset_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;		/**< Number of {source, sink} pairs */
+};
+
+struct dataset {
+	uint32_t *links;	/**< count {source, sink} pairs */
+	uint64_t count;
+	void *map;		/**< Mapping links points into, NULL if malloc()ed */
+	size_t mapSize;
+};
+
+extern int dataset_read(const char *path, struct dataset *ds,
+		unsigned int threads);
+extern int dataset_write(const char *path, struct dataset *ds, int format);
+extern void dataset_free(struct dataset *ds);
+extern int dataset_format(const char *name);
+
+#endif /* DATASET_H */
@@ -0,0 +1,236 @@
+/**
+ * generate.c
+ * Synthetic edge list generator for the benchmarks
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dataset.h"
+
+/* Edge generators */
+#define GEN_RMAT 0		/**< Recursive matrix, power-law degrees */
+#define GEN_UNIFORM 1		/**< Uniformly random endpoints */
+
+/* Edge orders */
+#define ORDER_RANDOM 0		/**< As generated */
+#define ORDER_SORTED 1		/**< Ascending, degenerates an unbalanced tree */
+#define ORDER_REVERSE 2		/**< Descending */
+
+/* splitmix64, the same seed gives the same graph everywhere */
+static uint64_t
+_gen_next(uint64_t *state)
+{
+	uint64_t z;
+
+	z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Uniform double in [0, 1) */
+static double
+_gen_unit(uint64_t *state)
+{
+	return (_gen_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * gen_rmat() - R-MAT edges over 2^scale nodes
+ * @a, @b, @c: Probabilities of the top-left, top-right and bottom-left
+ * quadrant, the bottom-right one gets the rest
+ *
+ * Every edge picks a quadrant once per bit of the node IDs. IDs are
+ * scrambled with an odd multiplier afterwards, so hubs don't all end up
+ * at low IDs.
+ */
+void
+gen_rmat(uint32_t *links, uint64_t count, unsigned int scale, double a,
+		double b, double c, uint64_t *state)
+{
+	uint64_t i;
+	uint32_t src, dst, mask;
+	unsigned int bit;
+	double r;
+
+	mask = (1u << scale) - 1;
+	for(i = 0; i < count; i++) {
+		src = 0;
+		dst = 0;
+		for(bit = 0; bit < scale; bit++) {
+			r = _gen_unit(state);
+			src <<= 1;
+			dst <<= 1;
+			if(r < a)
+				continue;
+			else if(r < a + b)
+				dst |= 1;
+			else if(r < a + b + c)
+				src |= 1;
+			else {
+				src |= 1;
+				dst |= 1;
+			}
+		}
+		links[i << 1] = (src * 0x9e3779b1u) & mask;
+		links[(i << 1) + 1] = (dst * 0x9e3779b1u) & mask;
+	}
+}
+
+void
+gen_uniform(uint32_t *links, uint64_t count, unsigned int scale,
+		uint64_t *state)
+{
+	uint64_t i, nodes = 1ULL << scale;
+
+	for(i = 0; i < count * 2; i++)
+		links[i] = _gen_next(state) % nodes;
+}
+
+static int
+_gen_cmp(const void *x, const void *y)
+{
+	const uint32_t *l = x, *r = y;
+
+	if(l[0] != r[0])
+		return (l[0] > r[0]) - (l[0] < r[0]);
+	return (l[1] > r[1]) - (l[1] < r[1]);
+}
+
+static int
+_gen_cmp_reverse(const void *x, const void *y)
+{
+	return _gen_cmp(y, x);
+}
+
+void
+usage()
+{
+	printf("Usage: generate [options] <out>\n");
+	printf("-g rmat|uniform   Generator, default rmat\n");
+	printf("-s scale          2^scale nodes, 1..31, default 16\n");
+	printf("-e factor         factor * 2^scale links, default 16\n");
+	printf("-o random|sorted|reverse\n");
+	printf("                  Order of the links, default random\n");
+	printf("-p a,b,c          R-MAT quadrant probabilities, default 0.57,0.19,0.19\n");
+	printf("-r seed           Random seed, default 1\n");
+	printf("-f bin|text|snap  Output format, default bin\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct dataset ds;
+	int i, gen = GEN_RMAT, order = ORDER_RANDOM, format = DATASET_BINARY;
+	unsigned int scale = 16, factor = 16;
+	double a = 0.57, b = 0.19, c = 0.19;
+	uint64_t seed = 1;
+	char *out = NULL;
+
+	for(i = 1; i < argc; i++) {
+		if(argv[i][0] != '-') {
+			if(out) {
+				usage();
+				return -1;
+			}
+			out = argv[i];
+			continue;
+		}
+		if(i + 1 >= argc) {
+			usage();
+			return -1;
+		}
+
+		if(!strcmp(argv[i], "-g")) {
+			i++;
+			if(!strcmp(argv[i], "rmat"))
+				gen = GEN_RMAT;
+			else if(!strcmp(argv[i], "uniform"))
+				gen = GEN_UNIFORM;
+			else
+				gen = -1;
+		} else if(!strcmp(argv[i], "-s")) {
+			scale = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-e")) {
+			factor = atoi(argv[++i]);
+		} else if(!strcmp(argv[i], "-o")) {
+			i++;
+			if(!strcmp(argv[i], "random"))
+				order = ORDER_RANDOM;
+			else if(!strcmp(argv[i], "sorted"))
+				order = ORDER_SORTED;
+			else if(!strcmp(argv[i], "reverse"))
+				order = ORDER_REVERSE;
+			else
+				order = -1;
+		} else if(!strcmp(argv[i], "-p")) {
+			if(sscanf(argv[++i], "%lf,%lf,%lf", &a, &b, &c) != 3)
+				a = -1;
+		} else if(!strcmp(argv[i], "-r")) {
+			seed = strtoull(argv[++i], NULL, 0);
+		} else if(!strcmp(argv[i], "-f")) {
+			format = dataset_format(argv[++i]);
+		} else {
+			gen = -1;
+		}
+	}
+
+	/* At most 31, so no node ID can be 0xffffffff, tb_clTree's
+	 * empty slot sentinel */
+	if(!out || gen < 0 || order < 0 || format < 0 || scale < 1 ||
+			scale > 31 || factor < 1 || a < 0 || b < 0 || c < 0 ||
+			a + b + c > 1) {
+		usage();
+		return -1;
+	}
+
+	ds.count = (uint64_t) factor << scale;
+	if(ds.count > UINT32_MAX) {
+		printf("Error: %lu links is more than a dataset can hold\n",
+				(unsigned long) ds.count);
+		return -1;
+	}
+	ds.links = malloc(ds.count * 2 * sizeof(uint32_t));
+	ds.map = NULL;
+	if(!ds.links) {
+		printf("Error: Out of memory\n");
+		return -1;
+	}
+
+	if(gen == GEN_RMAT)
+		gen_rmat(ds.links, ds.count, scale, a, b, c, &seed);
+	else
+		gen_uniform(ds.links, ds.count, scale, &seed);
+
+	if(order == ORDER_SORTED)
+		qsort(ds.links, ds.count, 2 * sizeof(uint32_t), _gen_cmp);
+	else if(order == ORDER_REVERSE)
+		qsort(ds.links, ds.count, 2 * sizeof(uint32_t), _gen_cmp_reverse);
+
+	if(dataset_write(out, &ds, format)) {
+		dataset_free(&ds);
+		return -1;
+	}
+	printf("%s: %lu links over %lu nodes\n", out, (unsigned long) ds.count,
+			(unsigned long) (1ULL << scale));
+
+	dataset_free(&ds);
+	return 0;
+}
@@ -19,6 +19,7 @@
  * USA
  */
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "test/cl.h"
@@ -30,6 +31,92 @@
 #define HEAP_KMA 0
 #define HEAP_PM 1
 
+/* Objects per work-item of clArrayList_test_justgrow_global */
+#define GROW_GLOBAL_OBJS 15
+
+/* Read back a flat copy, every work-item's pid must turn up exactly per times */
+int
+clArrayList_pid_check(cl_command_queue cq, cl_mem flat, size_t count,
+		size_t threads, unsigned int per)
+{
+	cl_int err;
+	size_t k, bad;
+	cl_uint *flatBack, *seen;
+
+	flatBack = malloc(count * sizeof(cl_uint));
+	seen = calloc(threads, sizeof(cl_uint));
+	if(!flatBack || !seen) {
+		printf("Error: Could not allocate flat copy on host\n");
+		return -1;
+	}
+	err = clEnqueueReadBuffer(cq, flat, CL_TRUE, 0,
+			count * sizeof(cl_uint), flatBack, 0, NULL, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not read flat copy: %i\n", err);
+		return -err;
+	}
+	for(k = 0, bad = 0; k < count; k++) {
+		if(flatBack[k] < threads)
+			seen[flatBack[k]]++;
+		else
+			bad++;
+	}
+	for(k = 0; k < threads; k++) {
+		if(seen[k] != per)
+			bad++;
+	}
+	free(flatBack);
+	free(seen);
+	if(bad) {
+		printf("Error: Flat copy has %zu wrong objects or work-items\n",
+				bad);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Let every work-item tag the objects clArrayList_test_justgrow_global handed
+ * it, then check each object of the list was written exactly once */
+int
+clArrayList_global_check(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, cl_mem al, cl_mem idx, size_t *wi, size_t threads)
+{
+	cl_int err;
+	cl_kernel kernel;
+	cl_mem flat;
+	size_t count;
+	int ret;
+
+	kernel = clCreateKernel(prg, "clArrayList_test_justgrow_global_fill", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &idx);
+	err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, wi, NULL, 0, NULL, NULL);
+	err |= clFinish(cq);
+	clReleaseKernel(kernel);
+	if (err != CL_SUCCESS) {
+		printf("Error: Could not execute fill kernel: %i\n", err);
+		return -err;
+	}
+
+	flat = clArrayList_flatten(cid, ctx, cq, prg, al, &count);
+	if(!flat || count != threads * GROW_GLOBAL_OBJS) {
+		printf("Error: List holds %zu objects, expected %zu\n",
+				flat ? count : 0, threads * GROW_GLOBAL_OBJS);
+		return -1;
+	}
+
+	ret = clArrayList_pid_check(cq, flat, count, threads, GROW_GLOBAL_OBJS);
+	clReleaseMemObject(flat);
+
+	return ret;
+}
+
 int
 clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		cl_program prg, const char *krnl, unsigned int backend)
@@ -37,8 +124,19 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int err;
 	unsigned int i;
 	unsigned int t, threads;
+	cl_uint args, bits;
+	cl_ulong base;
 	cl_kernel kernel_top, kernel_bottom;
-	cl_mem al, heap;
+	cl_mem al, heap, reduce = NULL, idx = NULL;
+	cl_event ev;
+	char name[64];
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not discover device address space\n");
+		return err;
+	}
 
 	/* Create correct kernels */
 	kernel_top = clCreateKernel(prg, krnl, &err);
@@ -46,6 +144,13 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		printf("Error: Could not create kernel: %i\n", err);
 		return err;
 	}
+
+	err = clGetKernelInfo(kernel_top, CL_KERNEL_NUM_ARGS, sizeof(cl_uint),
+			&args, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query kernel arguments: %i\n", err);
+		return err;
+	}
 /*
 	kernel_bottom = clCreateKernel(prg, "clArrayList_test_bottom", &err);
 	if(err != CL_SUCCESS) {
@@ -56,7 +161,7 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	/* Go */
 	printf("-- Executing %s --\n", krnl);
 	for(t = 0; t < options.wi_entries; t++) {
-		for(i = 0; i < tSamples; i++) {
+		for(i = 0; i < tRuns; i++) {
 			/* Set up the data structures */
 			if(backend == HEAP_KMA)
 				heap = kma_create(cid, ctx, cq, prg, 2048);
@@ -65,13 +170,29 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 			al = clArrayList_create(cid, ctx, cq, prg, sizeof(cl_uint), heap);
 			clSetKernelArg(kernel_top, 0, sizeof(cl_mem), &heap);
 			clSetKernelArg(kernel_top, 1, sizeof(cl_mem), &al);
+			if(args > 2)
+				clSetKernelArg(kernel_top, 2, clArrayList_scratch_size(
+						cid, kernel_top, 0), NULL);
+			/* At most one work-group per thread */
+			threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+			if(strstr(krnl, "global")) {
+				reduce = clArrayList_reduce_create(cid, ctx, cq, prg,
+						al, threads);
+				idx = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+						threads * (bits / 8), NULL, &err);
+				if(!reduce || err != CL_SUCCESS) {
+					printf("Error: Could not set up global grow\n");
+					return -1;
+				}
+				clSetKernelArg(kernel_top, 3, sizeof(cl_mem), &idx);
+			}
 			//clSetKernelArg(kernel_bottom, 1, sizeof(cl_mem), &al.list);
 			//clSetKernelArg(kernel_bottom, 0, sizeof(cl_mem), &al.heap);
 
 			/* Go 100 times */
 			tStart();
 			//for(j = 0; j < 100; j++) {
-				err = clEnqueueNDRangeKernel(cq, kernel_top, 3, NULL, &options.wi[t].x, NULL, 0, NULL, NULL);
+				err = clEnqueueNDRangeKernel(cq, kernel_top, 3, NULL, &options.wi[t].x, NULL, 0, NULL, &ev);
 				if (err != CL_SUCCESS) {
 					printf("Error: Could not execute kernel top: %i\n", err);
 					return -err;
@@ -81,6 +202,7 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 					printf("Error: Could not execute kernel: %i\n", err);
 					return -err;
 				}
+				tEvent(ev);
 
 				/*err = clEnqueueNDRangeKernel(cq, kernel_bottom, 1, NULL, &one, NULL, 0, NULL, NULL);
 				if (err != CL_SUCCESS) {
@@ -91,6 +213,25 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 			}*/
 			tEnd(i);
 
+			if(reduce) {
+				base = 0;
+				err = clEnqueueReadBuffer(cq, reduce, CL_TRUE,
+						CLARRAYLIST_REDUCE_BASE * (bits / 8), bits / 8,
+						&base, 0, NULL, NULL);
+				if(err != CL_SUCCESS) {
+					printf("Error: Could not read reduce memory: %i\n", err);
+					return -err;
+				}
+				if(base == 0) {
+					printf("Error: Global grow of %u objects failed\n",
+							threads * GROW_GLOBAL_OBJS);
+					return -1;
+				}
+				if(clArrayList_global_check(cid, ctx, cq, prg, al, idx,
+						&options.wi[t].x, threads))
+					return -1;
+			}
+
 			err = clEnqueueReadBuffer(cq, heap, CL_TRUE, 0, 393216, heapBack, 0, NULL, NULL);
 			if (err != CL_SUCCESS) {
 				printf("Error: Could not read from kernel: %i\n", err);
@@ -113,12 +254,21 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 				printf("Error: Could not free arraylist: %i\n", err);
 				return -err;
 			}
+
+			if(reduce) {
+				clReleaseMemObject(reduce);
+				clReleaseMemObject(idx);
+				reduce = NULL;
+				idx = NULL;
+			}
 			clFinish(cq);
 		}
 
 		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
 		printf("%-5u threads: ", threads);
-		tPrint();
+		snprintf(name, sizeof(name), "%s/%s", krnl,
+				backend == HEAP_KMA ? "kma" : "pma");
+		tPrint(name, threads);
 	}
 
 	clReleaseKernel(kernel_top);
@@ -127,6 +277,304 @@ clArrayList_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	return 0;
 }
 
+/* Grow one object at a time, then check pages doubled in capacity from
+ * CLARRAYLIST_PAGE_MIN up to CLARRAYLIST_PAGE_MAX */
+int
+clArrayList_grow_check(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, unsigned int backend)
+{
+	cl_int err;
+	cl_uint bits, n = 1000;
+	cl_ulong pages, objs, expPages, expObjs, cap, maxCap;
+	cl_kernel kernel;
+	cl_mem al, heap;
+	size_t one = 1;
+	union {
+		clArrayList_32 l32;
+		clArrayList_64 l64;
+	} back;
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not discover device address space\n");
+		return err;
+	}
+
+	kernel = clCreateKernel(prg, "clArrayList_test_grow_serial", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	if(backend == HEAP_KMA)
+		heap = kma_create(cid, ctx, cq, prg, 2048);
+	else
+		heap = pma_create(cid, ctx, cq, prg, 8388608);
+	al = clArrayList_create(cid, ctx, cq, prg, sizeof(cl_uint), heap);
+	clSetKernelArg(kernel, 0, sizeof(cl_mem), &heap);
+	clSetKernelArg(kernel, 1, sizeof(cl_mem), &al);
+	clSetKernelArg(kernel, 2, sizeof(cl_uint), &n);
+
+	err = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &one, NULL, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(cq, al, CL_TRUE, 0, bits == 32 ?
+			sizeof(clArrayList_32) : sizeof(clArrayList_64), &back,
+			0, NULL, NULL);
+	if (err != CL_SUCCESS) {
+		printf("Error: Could not execute kernel: %i\n", err);
+		return -err;
+	}
+
+	if(bits == 32) {
+		pages = back.l32.alloc >> CLARRAYLIST_ALLOC_SHIFT_32;
+		objs = back.l32.alloc &
+				((1ul << CLARRAYLIST_ALLOC_SHIFT_32) - 1);
+	} else {
+		pages = back.l64.alloc >> CLARRAYLIST_ALLOC_SHIFT_64;
+		objs = back.l64.alloc &
+				((1ull << CLARRAYLIST_ALLOC_SHIFT_64) - 1);
+	}
+
+	/* Page header is a queue item and three size_t */
+	maxCap = (CLARRAYLIST_PAGE_MAX - 4 * (bits / 8)) / sizeof(cl_uint);
+	for(expPages = 0, expObjs = 0, cap = CLARRAYLIST_PAGE_MIN;
+	    expObjs < n; expPages++, cap <<= 1) {
+		if(cap > maxCap)
+			cap = maxCap;
+		expObjs += cap;
+	}
+
+	printf("%u serial grows: %llu pages, %llu indices\n", n,
+			(unsigned long long) pages, (unsigned long long) objs);
+	if(pages != expPages || objs != expObjs) {
+		printf("Error: Expected %llu pages, %llu indices\n",
+				(unsigned long long) expPages,
+				(unsigned long long) expObjs);
+		return -1;
+	}
+
+	clReleaseMemObject(al);
+	clReleaseMemObject(heap);
+	clReleaseKernel(kernel);
+	return 0;
+}
+
+/* Fill the list with objects tagged with their own address, then check
+ * clArrayList_get returns them intact */
+int
+clArrayList_get_check(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, unsigned int backend)
+{
+	cl_int err;
+	cl_kernel fill, get;
+	cl_mem al, heap, cnt;
+	cl_event ev;
+	cl_uint cntBack[2];
+	unsigned int i, t, threads;
+	char name[64];
+
+	fill = clCreateKernel(prg, "clArrayList_test_get_fill", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	get = clCreateKernel(prg, "clArrayList_test_get", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	cnt = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(cntBack), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create counter buffer: %i\n", err);
+		return err;
+	}
+
+	printf("-- Executing clArrayList_test_get --\n");
+	for(t = 0; t < options.wi_entries; t++) {
+		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+		for(i = 0; i < tRuns; i++) {
+			if(backend == HEAP_KMA)
+				heap = kma_create(cid, ctx, cq, prg, 2048);
+			else
+				heap = pma_create(cid, ctx, cq, prg, 8388608);
+			al = clArrayList_create(cid, ctx, cq, prg, sizeof(cl_uint), heap);
+
+			clSetKernelArg(fill, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(fill, 1, sizeof(cl_mem), &al);
+			clSetKernelArg(fill, 2, clArrayList_scratch_size(cid, fill, 0),
+					NULL);
+			err = clEnqueueNDRangeKernel(cq, fill, 3, NULL, &options.wi[t].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute fill kernel: %i\n", err);
+				return -err;
+			}
+
+			cntBack[0] = 0;
+			cntBack[1] = 0;
+			clEnqueueWriteBuffer(cq, cnt, CL_TRUE, 0, sizeof(cntBack), cntBack, 0, NULL, NULL);
+			clSetKernelArg(get, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(get, 1, sizeof(cl_mem), &al);
+			clSetKernelArg(get, 2, sizeof(cl_mem), &cnt);
+
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, get, 3, NULL, &options.wi[t].x, NULL, 0, NULL, &ev);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev);
+			tEnd(i);
+
+			clEnqueueReadBuffer(cq, cnt, CL_TRUE, 0, sizeof(cntBack), cntBack, 0, NULL, NULL);
+			if(cntBack[0] == 0 || cntBack[1] != 0) {
+				printf("Error: %u of %u objects read back wrong\n",
+						cntBack[1], cntBack[0]);
+				return -1;
+			}
+
+			clReleaseMemObject(al);
+			clReleaseMemObject(heap);
+		}
+
+		printf("%-5u threads: ", threads);
+		snprintf(name, sizeof(name), "clArrayList_test_get/%s",
+				backend == HEAP_KMA ? "kma" : "pma");
+		tPrint(name, threads);
+	}
+
+	clReleaseMemObject(cnt);
+	clReleaseKernel(get);
+	clReleaseKernel(fill);
+	return 0;
+}
+
+/* Grow with clArrayList_test_justgrow once, then check the flat copy holds
+ * every object */
+int
+clArrayList_flatten_check(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, unsigned int backend)
+{
+	cl_int err;
+	cl_kernel kernel, kmap;
+	cl_mem al, heap, flat, cnt;
+	cl_event ev;
+	size_t count, threads;
+	cl_uint cntBack[2];
+	unsigned int t;
+
+	kernel = clCreateKernel(prg, "clArrayList_test_justgrow", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	kmap = clCreateKernel(prg, "clArrayList_foreach", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	cnt = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(cntBack), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create counter buffer: %i\n", err);
+		return err;
+	}
+
+	printf("-- Flattening clArrayList_test_justgrow --\n");
+	for(t = 0; t < options.wi_entries; t++) {
+		if(backend == HEAP_KMA)
+			heap = kma_create(cid, ctx, cq, prg, 2048);
+		else
+			heap = pma_create(cid, ctx, cq, prg, 8388608);
+		al = clArrayList_create(cid, ctx, cq, prg, sizeof(cl_uint), heap);
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &heap);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &al);
+		clSetKernelArg(kernel, 2, clArrayList_scratch_size(cid, kernel, 0),
+				NULL);
+
+		err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[t].x, NULL, 0, NULL, NULL);
+		err |= clFinish(cq);
+		if (err != CL_SUCCESS) {
+			printf("Error: Could not execute kernel: %i\n", err);
+			return -err;
+		}
+
+		tStart();
+		flat = clArrayList_flatten(cid, ctx, cq, prg, al, &count);
+		tEndSingle();
+
+		/* Ten rounds of alternating one and two objects */
+		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+		printf("%-5zu threads: %zu/%zu objects, ", threads, count,
+				threads * 15);
+		tPrint(backend == HEAP_KMA ? "clArrayList_flatten/kma" :
+				"clArrayList_flatten/pma", threads);
+		if(count != threads * 15) {
+			printf("Error: Flat copy holds %zu objects, expected %zu\n",
+					count, threads * 15);
+			return -1;
+		}
+
+		/* Every work-item's pid must turn up exactly 15 times */
+		err = clArrayList_pid_check(cq, flat, count, threads, 15);
+		clReleaseMemObject(flat);
+		if(err)
+			return -1;
+
+		/* Visit every object in place */
+		cntBack[0] = 0;
+		cntBack[1] = 0;
+		clEnqueueWriteBuffer(cq, cnt, CL_TRUE, 0, sizeof(cntBack), cntBack, 0, NULL, NULL);
+		clSetKernelArg(kmap, 0, sizeof(cl_mem), &al);
+		clSetKernelArg(kmap, 1, sizeof(cl_mem), &cnt);
+		tStart();
+		err = clEnqueueNDRangeKernel(cq, kmap, 3, NULL, &options.wi[t].x, NULL, 0, NULL, &ev);
+		err |= clFinish(cq);
+		if (err != CL_SUCCESS) {
+			printf("Error: Could not execute foreach kernel: %i\n", err);
+			return -err;
+		}
+		tEvent(ev);
+		tEndSingle();
+		clEnqueueReadBuffer(cq, cnt, CL_TRUE, 0, sizeof(cntBack), cntBack, 0, NULL, NULL);
+		printf("%-5zu threads: foreach %u objects, %u misplaced, ", threads,
+				cntBack[0], cntBack[1]);
+		tPrint(backend == HEAP_KMA ? "clArrayList_foreach/kma" :
+				"clArrayList_foreach/pma", threads);
+		if(cntBack[0] != count || cntBack[1] != 0) {
+			printf("Error: foreach visited %u objects, expected %zu, "
+					"%u misplaced\n", cntBack[0], count, cntBack[1]);
+			return -1;
+		}
+
+		/* Empty afterwards */
+		tStart();
+		clArrayList_clear_all(cid, cq, prg, al);
+		tEndSingle();
+		flat = clArrayList_flatten(cid, ctx, cq, prg, al, &count);
+		printf("%-5zu threads: %zu objects after clear, ", threads, count);
+		tPrint(backend == HEAP_KMA ? "clArrayList_clear_all/kma" :
+				"clArrayList_clear_all/pma", threads);
+		if(flat)
+			clReleaseMemObject(flat);
+		if(count != 0) {
+			printf("Error: %zu objects left after clear\n", count);
+			return -1;
+		}
+		clReleaseMemObject(al);
+		clReleaseMemObject(heap);
+	}
+
+	clReleaseMemObject(cnt);
+	clReleaseKernel(kmap);
+	clReleaseKernel(kernel);
+	return 0;
+}
+
 int
 clArrayList_opts(unsigned int i, unsigned int argc, char **argv)
 {
@@ -215,6 +663,14 @@ main(int argc, char** argv)
 		}
 		printf("\n");
 	}
+
+	if(clArrayList_grow_check(cid, ctx, cq, prg, HEAP_PM) ||
+	   clArrayList_get_check(cid, ctx, cq, prg, HEAP_PM))
+		return -1;
+	if(clArrayList_execute(cid, ctx, cq, prg, "clArrayList_test_justgrow_global", HEAP_PM))
+		return -1;
+	if(clArrayList_flatten_check(cid, ctx, cq, prg, HEAP_PM))
+		return -1;
 	printf("\n");
 
 	/* And KMA */
@@ -248,6 +704,14 @@ main(int argc, char** argv)
 		printf("\n");
 	}
 
+	if(clArrayList_grow_check(cid, ctx, cq, prg, HEAP_KMA) ||
+	   clArrayList_get_check(cid, ctx, cq, prg, HEAP_KMA))
+		return -1;
+	if(clArrayList_execute(cid, ctx, cq, prg, "clArrayList_test_justgrow_global", HEAP_KMA))
+		return -1;
+	if(clArrayList_flatten_check(cid, ctx, cq, prg, HEAP_KMA))
+		return -1;
+
 	free(heapBack);
 
 	free((void *)src[0]);
@@ -55,6 +55,7 @@ clIndexedQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int err;
 	unsigned int i, start;
 	cl_mem q, qData;
+	cl_event ev;
 	cl_kernel kernel;
 	size_t qsize;
 
@@ -70,7 +71,7 @@ clIndexedQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 	/* And go execute N times */
 	printf("-- Executing %s --\n", krnl);
-	for(i = 0; i < 1; i++) {
+	for(i = 0; i < tRuns; i++) {
 		qData = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (threads+1)*16, NULL, &err);
 
 		q = clIndexedQueue_create(cid, ctx, cq, prg, qData, 4);
@@ -81,12 +82,13 @@ clIndexedQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		tStart();
 
 		err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &elems, NULL,
-				0, NULL, NULL);
+				0, NULL, &ev);
 		err |= clFinish(cq);
 		if (err != CL_SUCCESS) {
 			printf("clQueue: Could not execute kernel: %i\n", err);
 			return -err;
 		}
+		tEvent(ev);
 		tEnd(i);
 
 		err = clEnqueueReadBuffer(cq, qData, CL_TRUE, 0, (threads+1)*16, qBack,
@@ -109,7 +111,7 @@ clIndexedQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		clFinish(cq);
 	}
 	printf("Time: ");
-	tPrint();
+	tPrint(krnl, threads);
 
 	/* Print buffer if requested */
 	if(options.print_buffer) {
@@ -54,6 +54,7 @@ clQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int err;
 	unsigned int i, start;
 	cl_mem q, qData;
+	cl_event ev;
 	cl_kernel kernel;
 
 	/* Create the right kernel */
@@ -64,7 +65,7 @@ clQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	}
 
 	/* And go execute N times */
-	for(i = 0; i < tSamples; i++) {
+	for(i = 0; i < tRuns; i++) {
 		q = clQueue_create(cid, ctx, cq, prg);
 		qPtrBack = malloc(sizeof(clqueue));
 
@@ -75,12 +76,13 @@ clQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		tStart();
 
 		err = clEnqueueNDRangeKernel(cq, kernel, DIMS, NULL, elems, elems_local,
-				0, NULL, NULL);
+				0, NULL, &ev);
 		err |= clFinish(cq);
 		if (err != CL_SUCCESS) {
 			printf("clQueue: Could not execute kernel: %i\n", err);
 			return -err;
 		}
+		tEvent(ev);
 		tEnd(i);
 
 		err = clEnqueueReadBuffer(cq, qData, CL_TRUE, 0, threads * 0x8, qBack,
@@ -105,7 +107,7 @@ clQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 	printf("-- Executing %s --\n", krnl);
 	printf("Time: ");
-	tPrint();
+	tPrint(krnl, threads);
 
 	/* Print buffer if requested */
 	if(options.print_buffer) {
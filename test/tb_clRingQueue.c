@@ -0,0 +1,236 @@
+/**
+ * tb_clRingQueue.c
+ * Throughput comparison of OpenCL ring queue and linked queue
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test/cl.h"
+#include "test/timing.h"
+#include "clQueue.h"
+#include "clRingQueue.h"
+
+#define QUEUE_LINKED 0
+#define QUEUE_RING 1
+
+/* One enqueue plus ten dequeue/enqueue pairs per work-item */
+#define OPS_PER_THREAD 21
+
+static cl_uint
+ceil_log2(size_t value)
+{
+	cl_uint l2 = 0;
+
+	while(((size_t) 1 << l2) < value)
+		l2++;
+
+	return l2;
+}
+
+int
+clRingQueue_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, char *krnl, unsigned int qtype)
+{
+	cl_int err;
+	unsigned int i, t, threads;
+	cl_mem q, qData, seen;
+	cl_event ev;
+	cl_kernel kernel, drain;
+	clRingQueue rBack;
+	cl_uint *seenBack, k, bad;
+
+	/* Create the right kernel */
+	kernel = clCreateKernel(prg, krnl, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	drain = clCreateKernel(prg, qtype == QUEUE_RING ?
+			"clRingQueue_test_drain" : "clQueue_test_drain", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	printf("-- Executing %s --\n", krnl);
+	for(t = 0; t < options.wi_entries; t++) {
+		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+		seenBack = malloc((threads + 1) * sizeof(cl_uint));
+		seen = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+				(threads + 1) * sizeof(cl_uint), NULL, &err);
+		if(!seenBack || err != CL_SUCCESS) {
+			printf("Error: Could not create check buffer: %i\n", err);
+			return -1;
+		}
+
+		for(i = 0; i < tRuns; i++) {
+			if(qtype == QUEUE_RING)
+				q = clRingQueue_create(cid, ctx, cq, prg,
+						ceil_log2(threads));
+			else
+				q = clQueue_create(cid, ctx, cq, prg);
+			if(!q)
+				return -1;
+
+			qData = clCreateBuffer(ctx, CL_MEM_READ_WRITE, threads * 16, NULL, &err);
+			if(err != CL_SUCCESS) {
+				printf("Error: Could not create data buffer: %i\n", err);
+				return err;
+			}
+
+			clSetKernelArg(kernel, 0, sizeof(cl_mem), &q);
+			clSetKernelArg(kernel, 1, sizeof(cl_mem), &qData);
+
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[t].x, NULL,
+					0, NULL, &ev);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev);
+			tEnd(i);
+
+			if(qtype == QUEUE_RING) {
+				err = clEnqueueReadBuffer(cq, q, CL_TRUE, 0, sizeof(clRingQueue),
+						&rBack, 0, NULL, NULL);
+				if (err != CL_SUCCESS) {
+					printf("Error: Could not read from kernel: %i\n", err);
+					return -err;
+				}
+
+				if(rBack.items != threads || rBack.tail - rBack.head != threads) {
+					printf("Queue invalid: %i items, head %08x tail %08x\n",
+							rBack.items, rBack.head, rBack.tail);
+					return -1;
+				}
+			}
+
+			/* Every item must come out exactly once */
+			memset(seenBack, 0, (threads + 1) * sizeof(cl_uint));
+			clEnqueueWriteBuffer(cq, seen, CL_TRUE, 0,
+					(threads + 1) * sizeof(cl_uint), seenBack, 0,
+					NULL, NULL);
+			clSetKernelArg(drain, 0, sizeof(cl_mem), &q);
+			clSetKernelArg(drain, 1, sizeof(cl_mem), &qData);
+			clSetKernelArg(drain, 2, sizeof(cl_mem), &seen);
+			err = clEnqueueNDRangeKernel(cq, drain, 3, NULL, &options.wi[t].x, NULL,
+					0, NULL, NULL);
+			err |= clEnqueueReadBuffer(cq, seen, CL_TRUE, 0,
+					(threads + 1) * sizeof(cl_uint), seenBack, 0,
+					NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not drain queue: %i\n", err);
+				return -err;
+			}
+
+			for(k = 0, bad = 0; k < threads; k++) {
+				if(seenBack[k] != 1)
+					bad++;
+			}
+			if(bad || seenBack[threads]) {
+				printf("Queue invalid: %u items lost or duplicated, "
+						"%u missing\n", bad, seenBack[threads]);
+				return -1;
+			}
+
+			clReleaseMemObject(q);
+			clReleaseMemObject(qData);
+			clFinish(cq);
+		}
+
+		printf("%-5u threads %-7u ops: ", threads, threads * OPS_PER_THREAD);
+		tPrint(krnl, threads);
+
+		clReleaseMemObject(seen);
+		free(seenBack);
+	}
+
+	clReleaseKernel(drain);
+	clReleaseKernel(kernel);
+	printf("\n");
+
+	return 0;
+}
+
+int
+clRingQueue_opts(unsigned int i, unsigned int argc, char **argv)
+{
+	return -1;
+}
+
+void
+usage()
+{
+	printf("Usage: clRingQueue [options]\n");
+	options_print();
+	return;
+}
+
+int
+main(int argc, char** argv) {
+	printf("Ring queue on OpenCL 0.1\n");
+
+	cl_platform_id pid;
+	cl_device_id cid;
+	cl_context ctx;
+	cl_command_queue cq;
+	cl_program prg;
+
+	char *src[2];
+
+	if(options_read(argc, argv, clRingQueue_opts)) {
+		usage();
+		return -1;
+	}
+
+	/* Get me a context */
+	if(clSetup(&pid, &cid, &ctx, &cq)) {
+		return -1;
+	}
+
+	src[0] = kernel_read("clQueue.cl");
+	src[1] = kernel_read("clRingQueue.cl");
+	if(!src[0] || !src[1])
+		return -1;
+
+	prg = program_compile(pid, ctx, &cid, 2, src);
+	if(prg < 0)
+		return -1;
+
+	/* Same workload on both queues */
+	printf("Linked queue:\n");
+	if(clRingQueue_execute(cid, ctx, cq, prg, "clQueue_test_enqueue", QUEUE_LINKED) ||
+	   clRingQueue_execute(cid, ctx, cq, prg, "clQueue_test_dequeue", QUEUE_LINKED))
+		return -1;
+
+	printf("Ring queue:\n");
+	if(clRingQueue_execute(cid, ctx, cq, prg, "clRingQueue_test_enqueue", QUEUE_RING) ||
+	   clRingQueue_execute(cid, ctx, cq, prg, "clRingQueue_test_dequeue", QUEUE_RING))
+		return -1;
+
+	free((void *)src[0]);
+	free((void *)src[1]);
+	clReleaseProgram(prg);
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+/**
+ * tb_clScheduler.c
+ * Benchmark for the persistent-threads task scheduler
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "test/cl.h"
+#include "test/timing.h"
+#include "kma.h"
+#include "clScheduler.h"
+
+#define LOCAL_SIZE 64
+#define DEQUE_SLOTS_L2 10
+
+unsigned int depth;
+
+static unsigned int
+fib(unsigned int n)
+{
+	unsigned int a = 0, b = 1, t;
+
+	while(n--) {
+		t = a + b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+int
+clScheduler_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int err;
+	unsigned int i, t, threads, groups;
+	cl_kernel seed, kernel;
+	cl_mem heap, sched, result;
+	cl_event ev;
+	cl_uint rBack[2];
+	size_t global, local = LOCAL_SIZE;
+	const size_t one = 1;
+
+	seed = clCreateKernel(prg, "clScheduler_test_seed", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	kernel = clCreateKernel(prg, "clScheduler_test", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	result = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(rBack), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create result buffer: %i\n", err);
+		return err;
+	}
+
+	printf("-- Executing clScheduler_test, fib(%u) --\n", depth);
+	for(t = 0; t < options.wi_entries; t++) {
+		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+		groups = (threads + LOCAL_SIZE - 1) / LOCAL_SIZE;
+		global = groups * LOCAL_SIZE;
+
+		for(i = 0; i < tRuns; i++) {
+			heap = kma_create(cid, ctx, cq, prg, 4096);
+			sched = clScheduler_create(cid, ctx, cq, prg, heap, groups,
+					DEQUE_SLOTS_L2);
+			if(!heap || !sched)
+				return -1;
+
+			clSetKernelArg(seed, 0, sizeof(cl_mem), &sched);
+			clSetKernelArg(seed, 1, sizeof(cl_mem), &result);
+			clSetKernelArg(seed, 2, sizeof(cl_uint), &depth);
+			err = clEnqueueNDRangeKernel(cq, seed, 1, NULL, &one, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not seed scheduler: %i\n", err);
+				return -err;
+			}
+
+			clSetKernelArg(kernel, 0, sizeof(cl_mem), &sched);
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, kernel, 1, NULL, &global, &local, 0, NULL, &ev);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev);
+			tEnd(i);
+
+			err = clEnqueueReadBuffer(cq, result, CL_TRUE, 0, sizeof(rBack), rBack,
+					0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not read from kernel: %i\n", err);
+				return -err;
+			}
+
+			if(rBack[1] || rBack[0] != fib(depth + 1)) {
+				printf("Result invalid: %u leaves (expected %u), %u failed spawns\n",
+						rBack[0], fib(depth + 1), rBack[1]);
+				return -1;
+			}
+
+			clReleaseMemObject(sched);
+			clReleaseMemObject(heap);
+			clFinish(cq);
+		}
+
+		printf("%-5zu threads %-5u groups %-8u tasks: ", global, groups,
+				2 * fib(depth + 1) - 1);
+		tPrint("clScheduler_test", threads);
+	}
+
+	clReleaseMemObject(result);
+	clReleaseKernel(seed);
+	clReleaseKernel(kernel);
+	printf("\n");
+
+	return 0;
+}
+
+int
+clScheduler_opts(unsigned int i, unsigned int argc, char **argv)
+{
+	if(strncmp(argv[i], "-n", 2) == 0) {
+		i++;
+		if(i < argc && sscanf(argv[i], "%u", &depth) == 1)
+			return 1;
+	}
+	return -1;
+}
+
+void
+usage()
+{
+	printf("Usage: clScheduler [options]\n");
+	printf("\t-n depth:\tFibonacci number to compute (default: 20)\n");
+	options_print();
+	return;
+}
+
+int
+main(int argc, char** argv)
+{
+	printf("Task scheduler on OpenCL 0.1\n");
+
+	cl_platform_id pid;
+	cl_device_id cid;
+	cl_context ctx;
+	cl_command_queue cq;
+	cl_program prg;
+
+	char *src[6];
+
+	depth = 20;
+	if(options_read(argc, argv, clScheduler_opts)) {
+		usage();
+		return -1;
+	}
+
+	/* Get me a context */
+	if(clSetup(&pid, &cid, &ctx, &cq)) {
+		return -1;
+	}
+
+	/* Compile the program! */
+	src[0] = kernel_read("clQueue.cl");
+	src[1] = kernel_read("clIndexedQueue.cl");
+	src[2] = kernel_read("kma.cl");
+	src[3] = kernel_read("clRingQueue.cl");
+	src[4] = kernel_read("clScheduler.cl");
+	src[5] = kernel_read("test/tb_clScheduler.cl");
+
+	prg = program_compile(pid, ctx, &cid, 6, src);
+	if(prg < 0)
+		return -1;
+
+	if(clScheduler_execute(cid, ctx, cq, prg))
+		return -1;
+
+	free((void *)src[0]);
+	free((void *)src[1]);
+	free((void *)src[2]);
+	free((void *)src[3]);
+	free((void *)src[4]);
+	free((void *)src[5]);
+	clReleaseProgram(prg);
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * tb_clScheduler.cl
+ * Test tasks for the persistent-threads scheduler
+ * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA
+ */
+#include "clScheduler.h"
+
+#define TASK_FIB 0
+
+/* Naive fibonacci: irregular, every task spawns up to two children.
+ * data points to two counters: leaves reached, failed spawns */
+void
+clTask_run(clScheduler __global *s, struct clTask __global *task)
+{
+	volatile unsigned int __global *result =
+			(volatile unsigned int __global *) task->data;
+
+	switch(task->type) {
+	case TASK_FIB:
+		if(task->arg < 2) {
+			atom_inc(&result[0]);
+			break;
+		}
+
+		if(!clScheduler_spawn(s, TASK_FIB, task->arg - 1, task->data))
+			atom_inc(&result[1]);
+		if(!clScheduler_spawn(s, TASK_FIB, task->arg - 2, task->data))
+			atom_inc(&result[1]);
+		break;
+	default:
+		break;
+	}
+}
+
+__kernel void
+clScheduler_test_seed(void __global *sched, unsigned int __global *result,
+		unsigned int n)
+{
+	clScheduler __global *s = (clScheduler __global *) sched;
+
+	result[0] = 0;
+	result[1] = 0;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	if(!clScheduler_spawn(s, TASK_FIB, n, (uintptr_t) result))
+		result[1] = 1;
+}
+
+__kernel void
+clScheduler_test(void __global *sched)
+{
+	clScheduler_run((clScheduler __global *) sched);
+}
@@ -29,15 +29,25 @@
 #include "kma.h"
 #include "pma.h"
 #include "clArrayList.h"
+#include "clHashMap.h"
+#include "clBTree.h"
+#include "clSort.h"
+#include "clRingQueue.h"
 #include "cl.h"
+#include "dataset.h"
 
 #define HEAP_KMA 0
 #define HEAP_PM 1
 
+#define STREAM_CHUNK 65536	/**< Links per upload when streaming */
+#define PR_ITERS 10		/**< PageRank iterations per sample */
+#define PR_DAMPING 0.85f
+
 char *dataset;
 
 cl_uint lcount;
 static uint32_t *links;
+static struct dataset ds;
 
 cl_mem
 _clTree_init_32(cl_context ctx, cl_command_queue cq)
@@ -147,6 +157,27 @@ clTree_pm_init(cl_device_id dev, cl_context ctx, cl_command_queue cq,
 	return pm;
 }
 
+/* Size of struct clGraph_node on the device: key and flags, five pointers
+ * and the id, padded to pointer alignment */
+size_t
+clGraph_node_size(cl_uint bits)
+{
+	if(bits == 32)
+		return 32;
+	return 56;
+}
+
+/* Log 2 of hash map slots, keeping the load below one half */
+cl_uint
+clTree_hash_size()
+{
+	cl_uint l2;
+
+	for(l2 = 4; ((size_t) 1 << l2) < ((size_t) lcount << 2); l2++);
+
+	return l2;
+}
+
 int
 clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		cl_program prg, char *kname, unsigned int htype)
@@ -154,8 +185,12 @@ clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int err;
 	unsigned int i, s;
 	unsigned int threads;
+	cl_uint args, bits;
+	size_t wgs, p2;
 	cl_kernel kernel;
 	cl_mem heap, tree, data;
+	cl_event ev;
+	char name[64];
 
 	/* Create correct kernels */
 	kernel = clCreateKernel(prg, kname, &err);
@@ -164,6 +199,18 @@ clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		return err;
 	}
 
+	err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint),
+			&args, NULL);
+	err |= clGetKernelWorkGroupInfo(kernel, cid, CL_KERNEL_WORK_GROUP_SIZE,
+			sizeof(size_t), &wgs, NULL);
+	err |= clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query kernel: %i\n", err);
+		return err;
+	}
+	for(p2 = 1; p2 < wgs; p2 <<= 1);
+
 	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
 	if(err != CL_SUCCESS) {
 		printf("Error: Could not create dataset buffer: %i\n", err);
@@ -179,17 +226,30 @@ clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	printf("-- Executing %s--\n", kname);
 	/* Set up the data structures */
 	for(i = 0; i < options.wi_entries; i++) {
-		for(s = 0; s < tSamples; s++) {
-			tree = clTree_create(cid, ctx, cq, prg);
+		for(s = 0; s < tRuns; s++) {
 			if(htype == HEAP_KMA)
 				heap = kma_create(cid, ctx, cq, prg, 512);
 			else
 				heap = pma_create(cid, ctx, cq, prg, 2097152);
+			/* Hash map and B-tree kernels take those in place of
+			 * the tree */
+			if(strstr(kname, "_hash"))
+				tree = clHashMap_create(cid, ctx, cq, prg, heap,
+						clTree_hash_size());
+			else if(strstr(kname, "_btree"))
+				tree = clBTree_create(cid, ctx, cq, prg, heap);
+			else
+				tree = clTree_create(cid, ctx, cq, prg);
 
 			clSetKernelArg(kernel, 0, sizeof(cl_mem), &heap);
 			clSetKernelArg(kernel, 1, sizeof(cl_mem), &tree);
 			clSetKernelArg(kernel, 2, sizeof(cl_mem), &data);
 			clSetKernelArg(kernel, 3, sizeof(unsigned int), &lcount);
+			/* Work-group scratch for the aggregating kernel */
+			if(args > 4) {
+				clSetKernelArg(kernel, 4, p2 * 2 * sizeof(cl_uint), NULL);
+				clSetKernelArg(kernel, 5, wgs * (bits / 8), NULL);
+			}
 			err = clFinish(cq);
 			if (err != CL_SUCCESS) {
 				printf("Error: Could not pre-execute kernel: %i\n", err);
@@ -198,12 +258,13 @@ clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 			tStart();
 			/* Go */
-			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev);
 			err |= clFinish(cq);
 			if (err != CL_SUCCESS) {
 				printf("Error: Could not execute kernel: %i\n", err);
 				return -err;
 			}
+			tEvent(ev);
 			tEnd(s);
 
 			err = clEnqueueReadBuffer(cq, heap, CL_TRUE, 0, KMA_SB_SIZE * 512, heapBack, 0, NULL, NULL);
@@ -233,7 +294,9 @@ clTree_execute(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
 		printf("Threads: %-5d", threads);
-		tPrint();
+		snprintf(name, sizeof(name), "%s/%s", kname,
+				htype == HEAP_KMA ? "kma" : "pma");
+		tPrint(name, threads);
 	}
 
 	clReleaseKernel(kernel);
@@ -249,8 +312,10 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int err;
 	unsigned int i, s;
 	unsigned int threads;
+	cl_uint bits;
 	cl_kernel kernel;
 	cl_mem heap, tree, data, al, allink;
+	cl_event ev;
 
 	/* Create correct kernels */
 	kernel = clCreateKernel(prg, "clTree_test_al", &err);
@@ -259,6 +324,13 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 		return err;
 	}
 
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query device: %i\n", err);
+		return err;
+	}
+
 	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
 	if(err != CL_SUCCESS) {
 		printf("Error: Could not create dataset buffer: %i\n", err);
@@ -274,10 +346,11 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	printf("-- Executing clTree_test_al --\n");
 	/* Set up the data structures */
 	for(i = 0; i < options.wi_entries; i++) {
-		for(s = 0; s < tSamples; s++) {
+		for(s = 0; s < tRuns; s++) {
 			tree = clTree_create(cid, ctx, cq, prg);
 			heap = kma_create(cid, ctx, cq, prg, 1024);
-			al = clArrayList_create(cid, ctx, cq, prg, 36, heap);
+			al = clArrayList_create(cid, ctx, cq, prg,
+					clGraph_node_size(bits), heap);
 			allink = clArrayList_create(cid, ctx, cq, prg, 16, heap);
 
 			clSetKernelArg(kernel, 0, sizeof(cl_mem), &al);
@@ -285,6 +358,8 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 			clSetKernelArg(kernel, 2, sizeof(cl_mem), &tree);
 			clSetKernelArg(kernel, 3, sizeof(cl_mem), &data);
 			clSetKernelArg(kernel, 4, sizeof(unsigned int), &lcount);
+			clSetKernelArg(kernel, 5, clArrayList_scratch_size(cid,
+					kernel, 0), NULL);
 			err = clFinish(cq);
 			if (err != CL_SUCCESS) {
 				printf("Error: Could not pre-execute kernel: %i\n", err);
@@ -293,12 +368,13 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 			tStart();
 			/* Go */
-			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev);
 			err |= clFinish(cq);
 			if (err != CL_SUCCESS) {
 				printf("Error: Could not execute kernel: %i\n", err);
 				return -err;
 			}
+			tEvent(ev);
 			tEnd(s);
 
 			err = clEnqueueReadBuffer(cq, heap, CL_TRUE, 0, KMA_SB_SIZE * 512, heapBack, 0, NULL, NULL);
@@ -338,7 +414,7 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
 		printf("Threads: %-5d", threads);
-		tPrint();
+		tPrint("clTree_test_al", threads);
 	}
 
 	clReleaseKernel(kernel);
@@ -347,44 +423,1095 @@ clTree_execute_al(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	return 0;
 }
 
+/* Build the tree with clTree_test_cache, then time kname looking up every
+ * link in it */
 int
-clTree_read_file()
+clTree_execute_lookup(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, char *kname)
 {
-	unsigned int entries, i;
-	struct {unsigned int source, sink;} *dt;
-	int ret;
-	FILE *fp;
+	cl_int err;
+	unsigned int i, s;
+	unsigned int threads;
+	cl_uint args, bits, found;
+	size_t wgs, p2;
+	cl_kernel build, kernel;
+	cl_mem heap, tree, data, hits;
+	cl_event ev;
 
-	if(dataset == NULL) {
-		printf("Error: No data set file specified\n");
-		return -1;
+	build = clCreateKernel(prg, "clTree_test_cache", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+	kernel = clCreateKernel(prg, kname, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
 	}
 
-	fp = fopen(dataset, "r");
-	if(!fp) {
-		printf("Error: specified file cannot be opened (%s)\n", dataset);
-		return -1;
+	err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint),
+			&args, NULL);
+	err |= clGetKernelWorkGroupInfo(kernel, cid, CL_KERNEL_WORK_GROUP_SIZE,
+			sizeof(size_t), &wgs, NULL);
+	err |= clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query kernel: %i\n", err);
+		return err;
+	}
+	for(p2 = 1; p2 < wgs; p2 <<= 1);
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create dataset buffer: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
+	}
+
+	hits = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create counter buffer: %i\n", err);
+		return err;
+	}
+
+	printf("-- Executing %s--\n", kname);
+	for(i = 0; i < options.wi_entries; i++) {
+		for(s = 0; s < tRuns; s++) {
+			heap = kma_create(cid, ctx, cq, prg, 512);
+			tree = clTree_create(cid, ctx, cq, prg);
+
+			clSetKernelArg(build, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 2, sizeof(cl_mem), &data);
+			clSetKernelArg(build, 3, sizeof(unsigned int), &lcount);
+			err = clEnqueueNDRangeKernel(cq, build, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not build tree: %i\n", err);
+				return -err;
+			}
+
+			found = 0;
+			clEnqueueWriteBuffer(cq, hits, CL_TRUE, 0, sizeof(cl_uint), &found, 0, NULL, NULL);
+			clSetKernelArg(kernel, 0, sizeof(cl_mem), &tree);
+			clSetKernelArg(kernel, 1, sizeof(cl_mem), &data);
+			clSetKernelArg(kernel, 2, sizeof(unsigned int), &lcount);
+			clSetKernelArg(kernel, 3, sizeof(cl_mem), &hits);
+			if(args > 4) {
+				clSetKernelArg(kernel, 4, p2 * 2 * sizeof(cl_uint), NULL);
+				clSetKernelArg(kernel, 5, wgs * (bits / 8), NULL);
+			}
+
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev);
+			tEnd(s);
+
+			clEnqueueReadBuffer(cq, hits, CL_TRUE, 0, sizeof(cl_uint), &found, 0, NULL, NULL);
+			clReleaseMemObject(heap);
+			clReleaseMemObject(tree);
+			clFinish(cq);
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d found %u/%u ", threads, found, lcount * 2);
+		tPrint(kname, threads);
+	}
+
+	clReleaseMemObject(hits);
+	clReleaseMemObject(data);
+	clReleaseKernel(kernel);
+	clReleaseKernel(build);
+	printf("\n");
+
+	return 0;
+}
+
+static int
+_clTree_cmp_uint(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Number of keys left after clTree_test_delete, worked out on the host */
+cl_uint
+clTree_live_keys()
+{
+	uint32_t *keys, *del;
+	cl_uint i, j, n = 0, d = 0, live = 0;
+
+	keys = malloc(lcount * 2 * sizeof(uint32_t));
+	del = malloc(((lcount + 1) / 2) * sizeof(uint32_t));
+	if(!keys || !del)
+		return 0;
+
+	memcpy(keys, links, lcount * 2 * sizeof(uint32_t));
+	for(i = 0; i < lcount; i += 2)
+		del[d++] = links[i << 1];
+	qsort(keys, lcount * 2, sizeof(uint32_t), _clTree_cmp_uint);
+	qsort(del, d, sizeof(uint32_t), _clTree_cmp_uint);
+
+	for(i = 0, j = 0; i < lcount * 2; i++) {
+		if(i > 0 && keys[i] == keys[i - 1])
+			continue;
+		n++;
+		while(j < d && del[j] < keys[i])
+			j++;
+		if(j == d || del[j] != keys[i])
+			live++;
+	}
+
+	free(keys);
+	free(del);
+	return live;
+}
+
+/* Build the tree with clTree_test_cache, delete part of it and time a range
+ * scan over all keys that are left */
+int
+clTree_execute_delete(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int err;
+	unsigned int i, s;
+	unsigned int threads;
+	cl_uint bits, deleted, expect, lo = 0, hi = 0xffffffff;
+	size_t count = 0;
+	cl_kernel build, del, scan, flush;
+	cl_mem heap, ep, tree, data, cnt, al, flat;
+	cl_event ev[3];
+
+	build = clCreateKernel(prg, "clTree_test_cache", &err);
+	del = clCreateKernel(prg, "clTree_test_delete", &err);
+	scan = clCreateKernel(prg, "clTree_test_scan", &err);
+	flush = clCreateKernel(prg, "kma_epoch_flush", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query device: %i\n", err);
+		return err;
+	}
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	cnt = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create buffers: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
+	}
+
+	expect = clTree_live_keys();
+
+	printf("-- Executing clTree_test_delete, clTree_test_scan --\n");
+	for(i = 0; i < options.wi_entries; i++) {
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+
+		for(s = 0; s < tRuns; s++) {
+			heap = kma_create(cid, ctx, cq, prg, 512);
+			tree = clTree_create(cid, ctx, cq, prg);
+			/* Work-group size is up to the implementation, so reserve a
+			 * record for every work-item to be safe */
+			ep = kma_epoch_create(cid, ctx, cq, prg, heap, threads);
+			al = clArrayList_create(cid, ctx, cq, prg, bits / 8, heap);
+			if(!heap || !tree || !ep || !al)
+				return -1;
+
+			clSetKernelArg(build, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 2, sizeof(cl_mem), &data);
+			clSetKernelArg(build, 3, sizeof(unsigned int), &lcount);
+			err = clEnqueueNDRangeKernel(cq, build, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not build tree: %i\n", err);
+				return -err;
+			}
+
+			deleted = 0;
+			clEnqueueWriteBuffer(cq, cnt, CL_TRUE, 0, sizeof(cl_uint), &deleted, 0, NULL, NULL);
+			clSetKernelArg(del, 0, sizeof(cl_mem), &ep);
+			clSetKernelArg(del, 1, sizeof(cl_mem), &tree);
+			clSetKernelArg(del, 2, sizeof(cl_mem), &data);
+			clSetKernelArg(del, 3, sizeof(unsigned int), &lcount);
+			clSetKernelArg(del, 4, sizeof(cl_mem), &cnt);
+			clSetKernelArg(flush, 0, sizeof(cl_mem), &ep);
+			clSetKernelArg(scan, 0, sizeof(cl_mem), &tree);
+			clSetKernelArg(scan, 1, sizeof(cl_uint), &lo);
+			clSetKernelArg(scan, 2, sizeof(cl_uint), &hi);
+			clSetKernelArg(scan, 3, sizeof(cl_mem), &al);
+
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, del, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev[0]);
+			err |= clEnqueueNDRangeKernel(cq, flush, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev[1]);
+			err |= clEnqueueNDRangeKernel(cq, scan, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev[2]);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev[0]);
+			tEvent(ev[1]);
+			tEvent(ev[2]);
+			tEnd(s);
+
+			clEnqueueReadBuffer(cq, cnt, CL_TRUE, 0, sizeof(cl_uint), &deleted, 0, NULL, NULL);
+			flat = clArrayList_flatten(cid, ctx, cq, prg, al, &count);
+			if(flat)
+				clReleaseMemObject(flat);
+			if(count != expect) {
+				printf("Error: Scan found %zu live links, expected %u\n",
+						count, expect);
+				return -1;
+			}
+
+			clReleaseMemObject(al);
+			clReleaseMemObject(ep);
+			clReleaseMemObject(tree);
+			clReleaseMemObject(heap);
+			clFinish(cq);
+		}
+
+		printf("Threads: %-5d deleted %u scanned %zu/%u ", threads, deleted,
+				count, expect);
+		tPrint("clTree_test_delete", threads);
+	}
+
+	clReleaseMemObject(cnt);
+	clReleaseMemObject(data);
+	clReleaseKernel(flush);
+	clReleaseKernel(scan);
+	clReleaseKernel(del);
+	clReleaseKernel(build);
+	printf("\n");
+
+	return 0;
+}
+
+/* Sort and deduplicate the endpoints of all links, then build a balanced
+ * tree over them in one kernel. Times the whole build, then counts the links
+ * that can be found in the result */
+int
+clTree_execute_balanced(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int err;
+	unsigned int i, s;
+	unsigned int threads;
+	cl_uint bits, found, n = 0;
+	cl_kernel build, lookup;
+	cl_mem keys, uKeys, tree, nodes, data, hits;
+
+	build = clCreateKernel(prg, "clTree_test_build_balanced", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+	lookup = clCreateKernel(prg, "clTree_test_get", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query device: %i\n", err);
+		return err;
+	}
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	keys = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	hits = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create buffers: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
+	}
+
+	printf("-- Executing clTree_test_build_balanced--\n");
+	for(i = 0; i < options.wi_entries; i++) {
+		for(s = 0; s < tRuns; s++) {
+			tree = clTree_create(cid, ctx, cq, prg);
+			/* Every endpoint is a key. Links are {source, sink} pairs
+			 * of uint32, so the dataset doubles as the key array */
+			clEnqueueCopyBuffer(cq, data, keys, 0, 0, lcount*8, 0, NULL, NULL);
+			clFinish(cq);
+
+			tStart();
+			if(clSort_radix(cid, ctx, cq, prg, keys, NULL, lcount * 2))
+				return -1;
+			n = clSort_unique(cid, ctx, cq, prg, keys, NULL, lcount * 2,
+					&uKeys, NULL);
+			if(n == 0)
+				return -1;
+
+			nodes = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+					n * clGraph_node_size(bits), NULL, &err);
+			if(err != CL_SUCCESS) {
+				printf("Error: Could not create node buffer: %i\n", err);
+				return err;
+			}
+
+			clSetKernelArg(build, 0, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &uKeys);
+			clSetKernelArg(build, 2, sizeof(cl_uint), &n);
+			clSetKernelArg(build, 3, sizeof(cl_mem), &nodes);
+			err = clEnqueueNDRangeKernel(cq, build, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEnd(s);
+
+			found = 0;
+			clEnqueueWriteBuffer(cq, hits, CL_TRUE, 0, sizeof(cl_uint), &found, 0, NULL, NULL);
+			clSetKernelArg(lookup, 0, sizeof(cl_mem), &tree);
+			clSetKernelArg(lookup, 1, sizeof(cl_mem), &data);
+			clSetKernelArg(lookup, 2, sizeof(unsigned int), &lcount);
+			clSetKernelArg(lookup, 3, sizeof(cl_mem), &hits);
+			err = clEnqueueNDRangeKernel(cq, lookup, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clEnqueueReadBuffer(cq, hits, CL_TRUE, 0, sizeof(cl_uint), &found, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not verify tree: %i\n", err);
+				return -err;
+			}
+
+			clReleaseMemObject(nodes);
+			clReleaseMemObject(uKeys);
+			clReleaseMemObject(tree);
+			clFinish(cq);
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d nodes %u found %u/%u ", threads, n, found,
+				lcount * 2);
+		tPrint("clTree_test_build_balanced", threads);
+	}
+
+	clReleaseMemObject(hits);
+	clReleaseMemObject(keys);
+	clReleaseMemObject(data);
+	clReleaseKernel(lookup);
+	clReleaseKernel(build);
+	printf("\n");
+
+	return 0;
+}
+
+/* Build the graph in CSR form without a tree: sort the endpoints, number
+ * the unique ones, then sort the edges by source ID */
+int
+clTree_execute_sort(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int err;
+	unsigned int i, s;
+	unsigned int threads;
+	cl_uint ends = lcount * 2, n = 0, edges = 0;
+	cl_kernel init, ids, offs;
+	cl_mem data, keys, pos, src, dst, marks, nodeKeys, offsets;
+
+	init = clCreateKernel(prg, "clGraph_sort_init", &err);
+	ids = clCreateKernel(prg, "clGraph_sort_ids", &err);
+	offs = clCreateKernel(prg, "clGraph_sort_offsets", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	keys = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	pos = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	src = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*4, NULL, &err);
+	dst = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*4, NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create buffers: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
 	}
 
-	ret = fscanf(fp, "%u\n", &entries);
-	if(ret < 1) {
-		printf("Error: Dataset file malformed\n");
+	printf("-- Executing sort-based graph build --\n");
+	for(i = 0; i < options.wi_entries; i++) {
+		for(s = 0; s < tRuns; s++) {
+			tStart();
+			clSetKernelArg(init, 0, sizeof(cl_mem), &data);
+			clSetKernelArg(init, 1, sizeof(cl_uint), &ends);
+			clSetKernelArg(init, 2, sizeof(cl_mem), &keys);
+			clSetKernelArg(init, 3, sizeof(cl_mem), &pos);
+			err = clEnqueueNDRangeKernel(cq, init, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+
+			if(clSort_radix(cid, ctx, cq, prg, keys, pos, ends))
+				return -1;
+			marks = clSort_unique_marks(cid, ctx, cq, prg, keys, ends, &n);
+			if(!marks)
+				return -1;
+
+			nodeKeys = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &err);
+			offsets = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (n + 1) * sizeof(cl_uint), NULL, &err);
+			if(err != CL_SUCCESS) {
+				printf("Error: Could not create node buffers: %i\n", err);
+				return err;
+			}
+
+			clSetKernelArg(ids, 0, sizeof(cl_mem), &keys);
+			clSetKernelArg(ids, 1, sizeof(cl_mem), &pos);
+			clSetKernelArg(ids, 2, sizeof(cl_uint), &ends);
+			clSetKernelArg(ids, 3, sizeof(cl_mem), &marks);
+			clSetKernelArg(ids, 4, sizeof(cl_mem), &src);
+			clSetKernelArg(ids, 5, sizeof(cl_mem), &dst);
+			clSetKernelArg(ids, 6, sizeof(cl_mem), &nodeKeys);
+			err = clEnqueueNDRangeKernel(cq, ids, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+
+			/* Stable, so sinks keep their input order per source */
+			if(clSort_radix(cid, ctx, cq, prg, src, dst, lcount))
+				return -1;
+
+			clSetKernelArg(offs, 0, sizeof(cl_mem), &src);
+			clSetKernelArg(offs, 1, sizeof(cl_uint), &lcount);
+			clSetKernelArg(offs, 2, sizeof(cl_uint), &n);
+			clSetKernelArg(offs, 3, sizeof(cl_mem), &offsets);
+			err = clEnqueueNDRangeKernel(cq, offs, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEnd(s);
+
+			clEnqueueReadBuffer(cq, offsets, CL_TRUE, n * sizeof(cl_uint),
+					sizeof(cl_uint), &edges, 0, NULL, NULL);
+			clReleaseMemObject(offsets);
+			clReleaseMemObject(nodeKeys);
+			clReleaseMemObject(marks);
+			clFinish(cq);
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d nodes %u edges %u/%u ", threads, n, edges,
+				lcount);
+		tPrint("clGraph_sort", threads);
+	}
+
+	clReleaseMemObject(dst);
+	clReleaseMemObject(src);
+	clReleaseMemObject(pos);
+	clReleaseMemObject(keys);
+	clReleaseMemObject(data);
+	clReleaseKernel(offs);
+	clReleaseKernel(ids);
+	clReleaseKernel(init);
+	printf("\n");
+
+	return 0;
+}
+
+/* Build the graph with clTree_test_cache, then time its export to CSR:
+ * collect the nodes, count and scan the degrees and fill in the sinks */
+int
+clTree_execute_csr(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int err;
+	unsigned int i, s, j;
+	unsigned int threads;
+	cl_uint bits, n = 0, bad, lo = 0, hi = 0xffffffff;
+	size_t count;
+	cl_kernel build, scan, degree, fill;
+	cl_mem heap, tree, data, al, nodes, csr;
+	cl_uint *csrBack;
+
+	build = clCreateKernel(prg, "clTree_test_cache", &err);
+	scan = clCreateKernel(prg, "clTree_test_scan", &err);
+	degree = clCreateKernel(prg, "clGraph_csr_degree", &err);
+	fill = clCreateKernel(prg, "clGraph_csr_fill", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query device: %i\n", err);
+		return err;
+	}
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create dataset buffer: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
+	}
+
+	/* Every link becomes one edge, at most one node per endpoint */
+	csrBack = malloc((lcount * 3 + 1) * sizeof(cl_uint));
+	if(!csrBack)
 		return -1;
+
+	printf("-- Executing CSR export --\n");
+	for(i = 0; i < options.wi_entries; i++) {
+		for(s = 0; s < tRuns; s++) {
+			heap = kma_create(cid, ctx, cq, prg, 512);
+			tree = clTree_create(cid, ctx, cq, prg);
+			al = clArrayList_create(cid, ctx, cq, prg, bits / 8, heap);
+			if(!heap || !tree || !al)
+				return -1;
+
+			clSetKernelArg(build, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 2, sizeof(cl_mem), &data);
+			clSetKernelArg(build, 3, sizeof(unsigned int), &lcount);
+			err = clEnqueueNDRangeKernel(cq, build, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not build tree: %i\n", err);
+				return -err;
+			}
+
+			tStart();
+			clSetKernelArg(scan, 0, sizeof(cl_mem), &tree);
+			clSetKernelArg(scan, 1, sizeof(cl_uint), &lo);
+			clSetKernelArg(scan, 2, sizeof(cl_uint), &hi);
+			clSetKernelArg(scan, 3, sizeof(cl_mem), &al);
+			err = clEnqueueNDRangeKernel(cq, scan, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+
+			nodes = clArrayList_flatten(cid, ctx, cq, prg, al, &count);
+			if(!nodes)
+				return -1;
+			n = count;
+
+			csr = clCreateBuffer(ctx, CL_MEM_READ_WRITE,
+					(n + 1 + lcount) * sizeof(cl_uint), NULL, &err);
+			if(err != CL_SUCCESS) {
+				printf("Error: Could not create CSR buffer: %i\n", err);
+				return err;
+			}
+
+			clSetKernelArg(degree, 0, sizeof(cl_mem), &nodes);
+			clSetKernelArg(degree, 1, sizeof(cl_uint), &n);
+			clSetKernelArg(degree, 2, sizeof(cl_mem), &csr);
+			err = clEnqueueNDRangeKernel(cq, degree, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+
+			if(clSort_prefix_sum(cid, ctx, cq, prg, csr, n))
+				return -1;
+
+			clSetKernelArg(fill, 0, sizeof(cl_mem), &nodes);
+			clSetKernelArg(fill, 1, sizeof(cl_uint), &n);
+			clSetKernelArg(fill, 2, sizeof(cl_mem), &csr);
+			err = clEnqueueNDRangeKernel(cq, fill, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+			err |= clEnqueueReadBuffer(cq, csr, CL_TRUE, 0,
+					(n + 1 + lcount) * sizeof(cl_uint), csrBack, 0, NULL, NULL);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not export CSR: %i\n", err);
+				return -err;
+			}
+			tEnd(s);
+
+			clReleaseMemObject(csr);
+			clReleaseMemObject(nodes);
+			clReleaseMemObject(al);
+			clReleaseMemObject(tree);
+			clReleaseMemObject(heap);
+			clFinish(cq);
+		}
+
+		/* Sanity check the last sample */
+		for(j = 0, bad = 0; j < csrBack[n] && j < lcount; j++) {
+			if(csrBack[n + 1 + j] >= n)
+				bad++;
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d nodes %u edges %u/%u bad %u ", threads, n,
+				csrBack[n], lcount, bad);
+		tPrint("clGraph_csr", threads);
+	}
+
+	free(csrBack);
+	clReleaseMemObject(data);
+	clReleaseKernel(fill);
+	clReleaseKernel(degree);
+	clReleaseKernel(scan);
+	clReleaseKernel(build);
+	printf("\n");
+
+	return 0;
+}
+
+/* Build the graph with kname, then time BFS and PageRank over the pointers
+ * it left behind. clTree_test_al keeps its nodes and links in ArrayLists,
+ * clTree_test_adj its sinks in adjacency blocks. Every link must show up in
+ * the degrees. */
+int
+clTree_execute_traverse(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, char *kname, unsigned int htype)
+{
+	cl_int err;
+	unsigned int i, s, it;
+	unsigned int threads;
+	cl_uint bits, n, slots_l2, depth, root = 0, lo = 0, hi = 0xffffffff;
+	cl_uint stats[2];
+	cl_float damping = PR_DAMPING;
+	uint64_t bfsEdges = 0, prEdges = 0, edges;
+	size_t count;
+	cl_uint *degBack;
+	cl_kernel build, scan, degree, bfsInit, bfs, prInit, prPush, prUpdate;
+	cl_mem heap, tree, data, al, allink, list, nodes, deg, level, qIn, qOut,
+			qTmp, st, rank, next;
+	cl_event ev, prEv[1 + PR_ITERS * 2];
+	char name[64];
+
+	build = clCreateKernel(prg, kname, &err);
+	scan = clCreateKernel(prg, "clTree_test_scan", &err);
+	degree = clCreateKernel(prg, "clGraph_csr_degree", &err);
+	bfsInit = clCreateKernel(prg, "clGraph_bfs_init", &err);
+	bfs = clCreateKernel(prg, "clGraph_bfs", &err);
+	prInit = clCreateKernel(prg, "clGraph_pr_init", &err);
+	prPush = clCreateKernel(prg, "clGraph_pr_push", &err);
+	prUpdate = clCreateKernel(prg, "clGraph_pr_update", &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	err = clGetDeviceInfo(cid, CL_DEVICE_ADDRESS_BITS, sizeof(cl_uint),
+			&bits, NULL);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not query device: %i\n", err);
+		return err;
+	}
+
+	data = clCreateBuffer(ctx, CL_MEM_READ_WRITE, lcount*8, NULL, &err);
+	st = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(stats), NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create buffers: %i\n", err);
+		return err;
+	}
+	err = clEnqueueWriteBuffer(cq, data, 1, 0, lcount*8, (uint32_t *)links, 0, NULL, NULL);
+	err |= clFinish(cq);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not upload dataset: %i\n", err);
+		return err;
 	}
 
-	dt = malloc(entries*sizeof(*dt));
-	for(i = 0; i < entries; i++) {
-		ret = fscanf(fp, "{%u,%u}\n", &dt[i].source, &dt[i].sink);
-		if(ret < 2){
-			printf("Error: Dataset file malformed\n");
+	printf("-- Executing BFS and PageRank on %s (%s) --\n", kname,
+			htype == HEAP_KMA ? "KMA" : "PMA");
+	for(i = 0; i < options.wi_entries; i++) {
+		/* Build once, traverse tRuns times */
+		if(htype == HEAP_KMA)
+			heap = kma_create(cid, ctx, cq, prg, 1024);
+		else
+			heap = pma_create(cid, ctx, cq, prg, 2097152);
+		tree = clTree_create(cid, ctx, cq, prg);
+		if(!heap || !tree)
+			return -1;
+
+		al = NULL;
+		allink = NULL;
+		if(strstr(kname, "_al")) {
+			al = clArrayList_create(cid, ctx, cq, prg,
+					clGraph_node_size(bits), heap);
+			allink = clArrayList_create(cid, ctx, cq, prg,
+					2 * (bits / 8), heap);
+			clSetKernelArg(build, 0, sizeof(cl_mem), &al);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &allink);
+			clSetKernelArg(build, 2, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 3, sizeof(cl_mem), &data);
+			clSetKernelArg(build, 4, sizeof(unsigned int), &lcount);
+			clSetKernelArg(build, 5, clArrayList_scratch_size(cid,
+					build, 0), NULL);
+		} else {
+			clSetKernelArg(build, 0, sizeof(cl_mem), &heap);
+			clSetKernelArg(build, 1, sizeof(cl_mem), &tree);
+			clSetKernelArg(build, 2, sizeof(cl_mem), &data);
+			clSetKernelArg(build, 3, sizeof(unsigned int), &lcount);
+		}
+		err = clEnqueueNDRangeKernel(cq, build, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+		err |= clFinish(cq);
+		if (err != CL_SUCCESS) {
+			printf("Error: Could not build graph: %i\n", err);
+			return -err;
+		}
+
+		/* Number the nodes */
+		list = clArrayList_create(cid, ctx, cq, prg, bits / 8, heap);
+		if(!list)
+			return -1;
+		clSetKernelArg(scan, 0, sizeof(cl_mem), &tree);
+		clSetKernelArg(scan, 1, sizeof(cl_uint), &lo);
+		clSetKernelArg(scan, 2, sizeof(cl_uint), &hi);
+		clSetKernelArg(scan, 3, sizeof(cl_mem), &list);
+		err = clEnqueueNDRangeKernel(cq, scan, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+		err |= clFinish(cq);
+		if (err != CL_SUCCESS) {
+			printf("Error: Could not collect nodes: %i\n", err);
+			return -err;
+		}
+		nodes = clArrayList_flatten(cid, ctx, cq, prg, list, &count);
+		if(!nodes)
+			return -1;
+		n = count;
+
+		deg = clCreateBuffer(ctx, CL_MEM_READ_WRITE, (n + 1) * sizeof(cl_uint), NULL, &err);
+		level = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &err);
+		rank = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_float), NULL, &err);
+		next = clCreateBuffer(ctx, CL_MEM_READ_WRITE, n * sizeof(cl_float), NULL, &err);
+		if(err != CL_SUCCESS) {
+			printf("Error: Could not create traversal buffers: %i\n", err);
+			return err;
+		}
+		clSetKernelArg(degree, 0, sizeof(cl_mem), &nodes);
+		clSetKernelArg(degree, 1, sizeof(cl_uint), &n);
+		clSetKernelArg(degree, 2, sizeof(cl_mem), &deg);
+		err = clEnqueueNDRangeKernel(cq, degree, 3, NULL, &options.wi[i].x, NULL, 0, NULL, NULL);
+		err |= clFinish(cq);
+		if (err != CL_SUCCESS) {
+			printf("Error: Could not number nodes: %i\n", err);
+			return -err;
+		}
+
+		degBack = malloc(n * sizeof(cl_uint));
+		if(!degBack) {
+			printf("Error: Could not allocate degrees on host\n");
+			return -1;
+		}
+		err = clEnqueueReadBuffer(cq, deg, CL_TRUE, 0, n * sizeof(cl_uint),
+				degBack, 0, NULL, NULL);
+		if(err != CL_SUCCESS) {
+			printf("Error: Could not read degrees: %i\n", err);
+			return -err;
+		}
+		for(s = 0, edges = 0; s < n; s++)
+			edges += degBack[s];
+		free(degBack);
+		if(edges != lcount) {
+			printf("Error: Graph holds %"PRIu64" edges, expected %u\n",
+					edges, lcount);
 			return -1;
 		}
+
+		/* A frontier never holds more than every node */
+		for(slots_l2 = 1; (1u << slots_l2) < n; slots_l2++);
+		qIn = clRingQueue_create(cid, ctx, cq, prg, slots_l2);
+		qOut = clRingQueue_create(cid, ctx, cq, prg, slots_l2);
+		if(!qIn || !qOut)
+			return -1;
+
+		/* BFS, one kernel per level */
+		depth = 0;
+		for(s = 0; s < tRuns; s++) {
+			bfsEdges = 0;
+			tStart();
+			clSetKernelArg(bfsInit, 0, sizeof(cl_mem), &nodes);
+			clSetKernelArg(bfsInit, 1, sizeof(cl_uint), &n);
+			clSetKernelArg(bfsInit, 2, sizeof(cl_mem), &level);
+			clSetKernelArg(bfsInit, 3, sizeof(cl_mem), &qIn);
+			clSetKernelArg(bfsInit, 4, sizeof(cl_uint), &root);
+			err = clEnqueueNDRangeKernel(cq, bfsInit, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			tEvent(ev);
+
+			for(depth = 0; ; depth++) {
+				stats[0] = 0;
+				stats[1] = 0;
+				clEnqueueWriteBuffer(cq, st, CL_FALSE, 0, sizeof(stats), stats, 0, NULL, NULL);
+				clSetKernelArg(bfs, 0, sizeof(cl_mem), &qIn);
+				clSetKernelArg(bfs, 1, sizeof(cl_mem), &qOut);
+				clSetKernelArg(bfs, 2, sizeof(cl_mem), &level);
+				clSetKernelArg(bfs, 3, sizeof(cl_uint), &depth);
+				clSetKernelArg(bfs, 4, sizeof(cl_mem), &st);
+				err = clEnqueueNDRangeKernel(cq, bfs, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &ev);
+				err |= clEnqueueReadBuffer(cq, st, CL_TRUE, 0, sizeof(stats), stats, 0, NULL, NULL);
+				if (err != CL_SUCCESS) {
+					printf("Error: Could not execute kernel: %i\n", err);
+					return -err;
+				}
+				tEvent(ev);
+
+				bfsEdges += stats[1];
+				qTmp = qIn;
+				qIn = qOut;
+				qOut = qTmp;
+				if(stats[0] == 0)
+					break;
+			}
+			tEnd(s);
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d BFS nodes %u levels %u edges %"PRIu64" ",
+				threads, n, depth, bfsEdges);
+		tPrintRate(bfsEdges, "edges");
+		snprintf(name, sizeof(name), "clGraph_bfs/%s/%s", kname,
+				htype == HEAP_KMA ? "kma" : "pma");
+		tPrint(name, threads);
+
+		/* PageRank, PR_ITERS push iterations */
+		clSetKernelArg(prInit, 0, sizeof(cl_uint), &n);
+		clSetKernelArg(prInit, 1, sizeof(cl_mem), &rank);
+		clSetKernelArg(prInit, 2, sizeof(cl_mem), &next);
+		clSetKernelArg(prPush, 0, sizeof(cl_mem), &nodes);
+		clSetKernelArg(prPush, 1, sizeof(cl_uint), &n);
+		clSetKernelArg(prPush, 2, sizeof(cl_mem), &deg);
+		clSetKernelArg(prPush, 3, sizeof(cl_mem), &rank);
+		clSetKernelArg(prPush, 4, sizeof(cl_mem), &next);
+		clSetKernelArg(prPush, 5, sizeof(cl_mem), &st);
+		clSetKernelArg(prUpdate, 0, sizeof(cl_uint), &n);
+		clSetKernelArg(prUpdate, 1, sizeof(cl_float), &damping);
+		clSetKernelArg(prUpdate, 2, sizeof(cl_mem), &rank);
+		clSetKernelArg(prUpdate, 3, sizeof(cl_mem), &next);
+		for(s = 0; s < tRuns; s++) {
+			stats[0] = 0;
+			stats[1] = 0;
+			clEnqueueWriteBuffer(cq, st, CL_TRUE, 0, sizeof(stats), stats, 0, NULL, NULL);
+
+			tStart();
+			err = clEnqueueNDRangeKernel(cq, prInit, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &prEv[0]);
+			for(it = 0; it < PR_ITERS; it++) {
+				err |= clEnqueueNDRangeKernel(cq, prPush, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &prEv[1 + it * 2]);
+				err |= clEnqueueNDRangeKernel(cq, prUpdate, 3, NULL, &options.wi[i].x, NULL, 0, NULL, &prEv[2 + it * 2]);
+			}
+			err |= clFinish(cq);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not execute kernel: %i\n", err);
+				return -err;
+			}
+			for(it = 0; it < 1 + PR_ITERS * 2; it++)
+				tEvent(prEv[it]);
+			tEnd(s);
+
+			clEnqueueReadBuffer(cq, st, CL_TRUE, 0, sizeof(stats), stats, 0, NULL, NULL);
+			prEdges = stats[1];
+		}
+
+		printf("Threads: %-5d PageRank %u iterations edges %"PRIu64" ",
+				threads, PR_ITERS, prEdges);
+		tPrintRate(prEdges, "edges");
+		snprintf(name, sizeof(name), "clGraph_pr/%s/%s", kname,
+				htype == HEAP_KMA ? "kma" : "pma");
+		tPrint(name, threads);
+
+		clReleaseMemObject(qOut);
+		clReleaseMemObject(qIn);
+		clReleaseMemObject(next);
+		clReleaseMemObject(rank);
+		clReleaseMemObject(level);
+		clReleaseMemObject(deg);
+		clReleaseMemObject(nodes);
+		clReleaseMemObject(list);
+		if(al)
+			clReleaseMemObject(al);
+		if(allink)
+			clReleaseMemObject(allink);
+		clReleaseMemObject(tree);
+		clReleaseMemObject(heap);
+		clFinish(cq);
 	}
 
-	lcount = entries;
-	links = (void *)dt;
+	clReleaseMemObject(st);
+	clReleaseMemObject(data);
+	clReleaseKernel(prUpdate);
+	clReleaseKernel(prPush);
+	clReleaseKernel(prInit);
+	clReleaseKernel(bfs);
+	clReleaseKernel(bfsInit);
+	clReleaseKernel(degree);
+	clReleaseKernel(scan);
+	clReleaseKernel(build);
+	printf("\n");
+
+	return 0;
+}
+
+/* Build the tree with kname chunk by chunk into one heap and tree. Chunks
+ * alternate between two device buffers, uploads on their own queue, so the
+ * upload of one chunk overlaps the build of the previous. */
+int
+clTree_execute_stream(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg, char *kname)
+{
+	cl_int err;
+	unsigned int i, s, b;
+	unsigned int threads;
+	cl_uint off, items, chunks;
+	cl_kernel kernel;
+	cl_command_queue cqUp;
+	cl_mem heap, tree, data[2];
+	cl_event upDone, built[2];
+
+	kernel = clCreateKernel(prg, kname, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create kernel: %i\n", err);
+		return err;
+	}
+
+	cqUp = clCreateCommandQueue(ctx, cid, 0, &err);
+	if(!cqUp) {
+		printf("Error: Could not create upload queue: %i\n", err);
+		return err;
+	}
+
+	data[0] = clCreateBuffer(ctx, CL_MEM_READ_ONLY, STREAM_CHUNK * 8, NULL, &err);
+	data[1] = clCreateBuffer(ctx, CL_MEM_READ_ONLY, STREAM_CHUNK * 8, NULL, &err);
+	if(err != CL_SUCCESS) {
+		printf("Error: Could not create chunk buffers: %i\n", err);
+		return err;
+	}
+
+	chunks = (lcount + STREAM_CHUNK - 1) / STREAM_CHUNK;
+	printf("-- Executing %s streaming %u chunks of %u --\n", kname, chunks,
+			STREAM_CHUNK);
+	for(i = 0; i < options.wi_entries; i++) {
+		for(s = 0; s < tRuns; s++) {
+			heap = kma_create(cid, ctx, cq, prg, 512);
+			tree = clTree_create(cid, ctx, cq, prg);
+			if(!heap || !tree)
+				return -1;
+			built[0] = NULL;
+			built[1] = NULL;
+
+			tStart();
+			for(off = 0, b = 0; off < lcount; off += items, b ^= 1) {
+				items = lcount - off;
+				if(items > STREAM_CHUNK)
+					items = STREAM_CHUNK;
+
+				/* Don't overwrite a buffer still being built from */
+				err = clEnqueueWriteBuffer(cqUp, data[b], CL_FALSE, 0,
+						items * 8, &links[off << 1],
+						built[b] ? 1 : 0,
+						built[b] ? &built[b] : NULL, &upDone);
+				if(built[b])
+					clReleaseEvent(built[b]);
+				if(err != CL_SUCCESS) {
+					printf("Error: Could not upload chunk: %i\n", err);
+					return -err;
+				}
+
+				clSetKernelArg(kernel, 0, sizeof(cl_mem), &heap);
+				clSetKernelArg(kernel, 1, sizeof(cl_mem), &tree);
+				clSetKernelArg(kernel, 2, sizeof(cl_mem), &data[b]);
+				clSetKernelArg(kernel, 3, sizeof(unsigned int), &items);
+				err = clEnqueueNDRangeKernel(cq, kernel, 3, NULL,
+						&options.wi[i].x, NULL, 1, &upDone,
+						&built[b]);
+				clReleaseEvent(upDone);
+				if(err != CL_SUCCESS) {
+					printf("Error: Could not execute kernel: %i\n", err);
+					return -err;
+				}
+
+				clFlush(cqUp);
+				clFlush(cq);
+			}
+			err = clFinish(cq);
+			err |= clFinish(cqUp);
+			if (err != CL_SUCCESS) {
+				printf("Error: Could not finish build: %i\n", err);
+				return -err;
+			}
+			tEnd(s);
+
+			for(b = 0; b < 2; b++) {
+				if(built[b])
+					clReleaseEvent(built[b]);
+			}
+			clReleaseMemObject(tree);
+			clReleaseMemObject(heap);
+		}
+
+		threads = options.wi[i].x * options.wi[i].y * options.wi[i].z;
+		printf("Threads: %-5d ", threads);
+		tPrint(kname, threads);
+	}
+
+	clReleaseMemObject(data[1]);
+	clReleaseMemObject(data[0]);
+	clReleaseCommandQueue(cqUp);
+	clReleaseKernel(kernel);
+	printf("\n");
+
+	return 0;
+}
+
+int
+clTree_read_file()
+{
+	if(dataset == NULL) {
+		printf("Error: No data set file specified\n");
+		return -1;
+	}
+
+	if(dataset_read(dataset, &ds, 0) < 0)
+		return -1;
+
+	/* Buffers are sized lcount * 8 bytes in 32-bit arithmetic */
+	if(ds.count > UINT32_MAX / 8) {
+		printf("Error: Dataset too large, at most %u edges\n",
+				UINT32_MAX / 8);
+		return -1;
+	}
+
+	lcount = ds.count;
+	links = ds.links;
 
-	fclose(fp);
 	return 0;
 }
 
@@ -406,6 +1533,8 @@ usage()
 	options_print();
 	printf("The data file begins with the number of entries, followed by\n");
 	printf("a series of {source, sink} tuples, each on a new line.\n");
+	printf("SNAP edge lists and the binary format written by convert are\n");
+	printf("accepted as well.\n");
 	return;
 }
 
@@ -420,7 +1549,7 @@ main(int argc, char** argv)
 	cl_command_queue cq;
 	cl_program prg;
 
-	char *src[6];
+	char *src[10];
 
 	dataset = NULL;
 	if(options_read(argc, argv, clTree_opts)) {
@@ -443,9 +1572,13 @@ main(int argc, char** argv)
 	src[2] = kernel_read("kma.cl");
 	src[3] = kernel_read("clTree.cl");
 	src[4] = kernel_read("clArrayList.cl");
-	src[5] = kernel_read("test/tb_clTree.cl");
+	src[5] = kernel_read("clHashMap.cl");
+	src[6] = kernel_read("clBTree.cl");
+	src[7] = kernel_read("clSort.cl");
+	src[8] = kernel_read("clRingQueue.cl");
+	src[9] = kernel_read("test/tb_clTree.cl");
 
-	prg = program_compile(pid, ctx, &cid, 6, src);
+	prg = program_compile(pid, ctx, &cid, 10, src);
 	if(prg < 0)
 		return -1;
 
@@ -463,9 +1596,42 @@ main(int argc, char** argv)
 	printf("\n");*/
 	clTree_execute(cid, ctx, cq, prg, "clTree_test_cache", HEAP_KMA);
 
+	/* Same graph through a hash map */
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_hash", HEAP_KMA);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_btree", HEAP_KMA);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_adj", HEAP_KMA);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_aggregate", HEAP_KMA);
+
+	/* Same, with edges arriving in chunks */
+	clTree_execute_stream(cid, ctx, cq, prg, "clTree_test_cache");
+
+	/* Lookups on a built tree */
+	clTree_execute_lookup(cid, ctx, cq, prg, "clTree_test_get");
+	clTree_execute_lookup(cid, ctx, cq, prg, "clTree_test_get_many");
+	clTree_execute_lookup(cid, ctx, cq, prg, "clTree_test_get_cached");
+
+	/* Bulk build from sorted keys */
+	clTree_execute_balanced(cid, ctx, cq, prg);
+
+	/* Delete and range scan */
+	if(clTree_execute_delete(cid, ctx, cq, prg))
+		return -1;
+
+	/* Same graph, bulk-synchronous */
+	clTree_execute_sort(cid, ctx, cq, prg);
+
+	/* Export the pointer-based graph */
+	clTree_execute_csr(cid, ctx, cq, prg);
+
 	/* Now with ArrayList */
 	clTree_execute_al(cid, ctx, cq, prg);
 
+	/* Traversal of what each construction variant leaves behind */
+	if(clTree_execute_traverse(cid, ctx, cq, prg, "clTree_test", HEAP_KMA) ||
+	   clTree_execute_traverse(cid, ctx, cq, prg, "clTree_test_al", HEAP_KMA) ||
+	   clTree_execute_traverse(cid, ctx, cq, prg, "clTree_test_adj", HEAP_KMA))
+		return -1;
+
 	/*heap = (unsigned int *)heapBack;
 	for(i = 0; i < (49152 >> 2); i++) {
 		if((i & 0x3) == 0)
@@ -477,15 +1643,20 @@ main(int argc, char** argv)
 	/* Now with poormans heap */
 	free((void *)src[2]);
 	src[2] = kernel_read("pma.cl");
-	prg = program_compile(pid, ctx, &cid, 6, src);
+	prg = program_compile(pid, ctx, &cid, 10, src);
 	if(prg < 0)
 		return -1;
 
 	printf("Poormans heap:\n");
 	clTree_execute(cid, ctx, cq, prg, "clTree_test_cache", HEAP_PM);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_hash", HEAP_PM);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_btree", HEAP_PM);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_adj", HEAP_PM);
+	clTree_execute(cid, ctx, cq, prg, "clTree_test_aggregate", HEAP_PM);
+	if(clTree_execute_traverse(cid, ctx, cq, prg, "clTree_test", HEAP_PM))
+		return -1;
 
-	if(links)
-		free(links);
+	dataset_free(&ds);
 
 	free((void *)src[0]);
 	free((void *)src[1]);
@@ -8,6 +8,9 @@
 #include "test/tb_clTree.h"
 #include "clheap.h"
 #include "clArrayList.h"
+#include "clHashMap.h"
+#include "clBTree.h"
+#include "clRingQueue.h"
 
 struct clGraph_node __global *
 clGraph_node_ensure(struct clheap __global *heap, struct clTree __global *tree,
@@ -24,6 +27,7 @@ clGraph_node_ensure(struct clheap __global *heap, struct clTree __global *tree,
 				continue;
 			node->tree.key = key;
 			clQueue_init(&node->links);
+			node->adj = NULL;
 			mem_fence(CLK_GLOBAL_MEM_FENCE);
 
 			if(!clTree_add(tree, &node->tree)) {
@@ -84,6 +88,189 @@ clTree_test(void __global *hp, void __global *pTree,
 	}*/
 }
 
+/**
+ * clGraph_adj_add() - Append sink to the adjacency blocks of node
+ * @return 1 on success, 0 if out of memory
+ *
+ * Slots of the newest block are claimed with atom_inc. Whoever finds it full
+ * puts a new block in front, holding its sink already. A slot is claimed
+ * before it is written, so the blocks are only complete once the kernel is
+ * done.
+ */
+unsigned int
+clGraph_adj_add(struct clheap __global *heap, struct clGraph_node __global *node,
+		struct clGraph_node __global *sink)
+{
+	struct clGraph_adj __global *blk, *nb;
+	unsigned int slot;
+
+	while(1) {
+		blk = (struct clGraph_adj __global *) node->adj;
+		if(blk) {
+			slot = atom_inc(&blk->fill);
+			if(slot < CLGRAPH_ADJ_SLOTS) {
+				blk->sink[slot] = sink;
+				return 1;
+			}
+		}
+
+		nb = (struct clGraph_adj __global *)
+				malloc(heap, sizeof(struct clGraph_adj));
+		if(!nb)
+			return 0;
+		nb->next = blk;
+		nb->fill = 1;
+		nb->sink[0] = sink;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		if(atom_cmpxchg(&node->adj, (uintptr_t) blk, (uintptr_t) nb) ==
+				(uintptr_t) blk)
+			return 1;
+		free(heap, (uintptr_t) nb);
+	}
+}
+
+/**
+ * clGraph_sink_next() - Walk the sinks of a node
+ * @node: Node
+ * @it: Cursor, NULL to start from the first sink
+ * @slot: Slot in the current adjacency block
+ * @return The next sink, NULL once all have been visited
+ *
+ * Follows the adjacency blocks of clGraph_adj_add() if the node has any, its
+ * link queue otherwise. Only valid once the building kernel is done.
+ */
+struct clGraph_node __global *
+clGraph_sink_next(struct clGraph_node __global *node, uintptr_t *it,
+		unsigned int *slot)
+{
+	struct clGraph_adj __global *blk;
+	struct clGraph_link __global *link;
+
+	if(node->adj) {
+		if(*it == NULL) {
+			blk = (struct clGraph_adj __global *) node->adj;
+			*slot = 0;
+		} else {
+			blk = (struct clGraph_adj __global *) *it;
+		}
+
+		while(blk && *slot >= min(blk->fill, (unsigned int) CLGRAPH_ADJ_SLOTS)) {
+			blk = blk->next;
+			*slot = 0;
+		}
+		if(!blk)
+			return NULL;
+
+		*it = (uintptr_t) blk;
+		return blk->sink[(*slot)++];
+	}
+
+	if(*it == NULL)
+		link = (struct clGraph_link __global *) node->links.head;
+	else
+		link = (struct clGraph_link __global *)
+				((struct clGraph_link __global *) *it)->q.next;
+	if(!link)
+		return NULL;
+
+	*it = (uintptr_t) link;
+	return link->sink;
+}
+
+/* Same as clTree_test, with the edges of a work-group grouped by source. The
+ * first of every group looks the source up and enqueues all their links as
+ * one chain. sort holds one uint2 per work-item rounded up to a power of
+ * two, chain one pointer per work-item. */
+__kernel void
+clTree_test_aggregate(void __global *hp, void __global *pTree,
+		struct clTree_link __global *data, unsigned int items,
+		uint2 __local *sort, uintptr_t __local *chain)
+{
+	struct clheap __global *heap = (struct clheap __global *) hp;
+	struct clGraph_node __global *source, *sink;
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	struct clGraph_link __global *link;
+	clqueue_item __global *prev;
+	size_t pid = 0, stride, lid = 0, lsize, n, j;
+	unsigned int i, itemsCeil;
+	uint2 a;
+
+	for(i = 0, stride = 1, lsize = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+		lid += lsize * get_local_id(i);
+		lsize *= get_local_size(i);
+	}
+	for(n = 1; n < lsize; n <<= 1);
+
+	/* Everyone takes part in every batch */
+	itemsCeil = items % stride;
+	if(itemsCeil)
+		itemsCeil = stride - itemsCeil;
+	itemsCeil += items;
+
+	for(i = pid; i < itemsCeil; i += stride) {
+		link = NULL;
+		if(i < items) {
+			sink = clGraph_node_ensure(heap, tree, data[i].sink);
+			link = (struct clGraph_link __global *)
+					malloc(heap, sizeof(struct clGraph_link));
+			if(link)
+				link->sink = sink;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		chain[lid] = (uintptr_t) link;
+		for(j = lid; j < n; j += lsize) {
+			sort[j].x = (j == lid && link) ? data[i].source : 0xffffffff;
+			sort[j].y = j;
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+		clTree_sort_local(sort, n);
+
+		/* Padding sorts last, the first of each run does the work */
+		a = sort[lid];
+		if(a.x != 0xffffffff && (lid == 0 || sort[lid - 1].x != a.x)) {
+			source = clGraph_node_ensure(heap, tree, a.x);
+			prev = (clqueue_item __global *) chain[a.y];
+			for(j = lid + 1; j < lsize && sort[j].x == a.x; j++) {
+				prev->next = chain[sort[j].y];
+				prev = (clqueue_item __global *) prev->next;
+			}
+			mem_fence(CLK_GLOBAL_MEM_FENCE);
+			enqueue_chain(&source->links,
+					(clqueue_item __global *) chain[a.y], prev);
+		}
+	}
+}
+
+/* Same as clTree_test, with adjacency blocks instead of a link per edge */
+__kernel void
+clTree_test_adj(void __global *hp, void __global *pTree,
+		struct clTree_link __global *data, unsigned int items)
+{
+	struct clheap __global *heap = (struct clheap __global *) hp;
+	struct clGraph_node __global *source, *sink;
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	size_t pid = 0, stride;
+	unsigned int i;
+	struct clTree_link __global *item;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < items; i += stride) {
+		item = &data[i];
+		source = clGraph_node_ensure(heap, tree, item->source);
+		sink = clGraph_node_ensure(heap, tree, item->sink);
+		if(!clGraph_adj_add(heap, source, sink))
+			return;
+	}
+}
+
 __kernel void
 clTree_test_cache(void __global *hp, void __global *pTree,
 		struct clTree_link __global *data, unsigned int items)
@@ -127,6 +314,7 @@ clTree_test_cache(void __global *hp, void __global *pTree,
 				}
 				source->tree.key = item->source;
 				clQueue_init(&source->links);
+				source->adj = NULL;
 				mem_fence(CLK_GLOBAL_MEM_FENCE);
 				if(!clTree_add(tree, &source->tree)) {
 					cache = source;
@@ -151,6 +339,7 @@ clTree_test_cache(void __global *hp, void __global *pTree,
 				}
 				sink->tree.key = item->sink;
 				clQueue_init(&sink->links);
+				sink->adj = NULL;
 				mem_fence(CLK_GLOBAL_MEM_FENCE);
 				if(!clTree_add(tree, &sink->tree)) {
 					cache = sink;
@@ -172,9 +361,152 @@ clTree_test_cache(void __global *hp, void __global *pTree,
 		free(heap, cache);
 }
 
+/**
+ * clGraph_node_ensure_hash() - clGraph_node_ensure on a hash map
+ * @cache: Node that lost an earlier race, reused if not NULL
+ */
+struct clGraph_node __global *
+clGraph_node_ensure_hash(struct clheap __global *heap, clHashMap __global *map,
+		unsigned int key, struct clGraph_node __global **cache)
+{
+	struct clGraph_node __global *node, *present;
+
+	node = (struct clGraph_node __global *) clHashMap_get(map, key);
+	if(node)
+		return node;
+
+	if(*cache) {
+		node = *cache;
+		*cache = NULL;
+	} else {
+		node = (struct clGraph_node __global *)
+				malloc(heap, sizeof(struct clGraph_node));
+		if(!node)
+			return NULL;
+	}
+	node->tree.key = key;
+	clQueue_init(&node->links);
+	node->adj = NULL;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	present = (struct clGraph_node __global *)
+			clHashMap_add(map, key, (uintptr_t) node);
+	if(present != node)
+		*cache = node;
+
+	return present;
+}
+
 __kernel void
-clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
+clTree_test_hash(void __global *hp, void __global *pMap,
+		struct clTree_link __global *data, unsigned int items)
+{
+	struct clheap __global *heap = (struct clheap __global *) hp;
+	clHashMap __global *map = (clHashMap __global *) pMap;
+	struct clGraph_node __global *source, *sink;
+	struct clGraph_node __global *cache = NULL;
+	size_t pid = 0, stride;
+	unsigned int i;
+	struct clTree_link __global *item;
+	struct clGraph_link __global *link;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < items; i += stride) {
+		item = &data[i];
+		source = clGraph_node_ensure_hash(heap, map, item->source, &cache);
+		sink = clGraph_node_ensure_hash(heap, map, item->sink, &cache);
+		if(!source || !sink)
+			return;
+
+		link = (struct clGraph_link __global *)
+				malloc(heap, sizeof(struct clGraph_link));
+		if(!link)
+			return;
+		link->sink = sink;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		enqueue(&source->links, &link->q);
+	}
+}
+
+/**
+ * clGraph_node_ensure_btree() - clGraph_node_ensure on a B-link tree
+ * @cache: Node that lost an earlier race, reused if not NULL
+ */
+struct clGraph_node __global *
+clGraph_node_ensure_btree(struct clheap __global *heap, clBTree __global *bt,
+		unsigned int key, struct clGraph_node __global **cache)
+{
+	struct clGraph_node __global *node, *present;
+
+	node = (struct clGraph_node __global *) clBTree_get(bt, key);
+	if(node)
+		return node;
+
+	if(*cache) {
+		node = *cache;
+		*cache = NULL;
+	} else {
+		node = (struct clGraph_node __global *)
+				malloc(heap, sizeof(struct clGraph_node));
+		if(!node)
+			return NULL;
+	}
+	node->tree.key = key;
+	clQueue_init(&node->links);
+	node->adj = NULL;
+	mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+	present = (struct clGraph_node __global *)
+			clBTree_add(bt, key, (uintptr_t) node);
+	if(present != node)
+		*cache = node;
+
+	return present;
+}
+
+__kernel void
+clTree_test_btree(void __global *hp, void __global *pTree,
 		struct clTree_link __global *data, unsigned int items)
+{
+	struct clheap __global *heap = (struct clheap __global *) hp;
+	clBTree __global *bt = (clBTree __global *) pTree;
+	struct clGraph_node __global *source, *sink;
+	struct clGraph_node __global *cache = NULL;
+	size_t pid = 0, stride;
+	unsigned int i;
+	struct clTree_link __global *item;
+	struct clGraph_link __global *link;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < items; i += stride) {
+		item = &data[i];
+		source = clGraph_node_ensure_btree(heap, bt, item->source, &cache);
+		sink = clGraph_node_ensure_btree(heap, bt, item->sink, &cache);
+		if(!source || !sink)
+			return;
+
+		link = (struct clGraph_link __global *)
+				malloc(heap, sizeof(struct clGraph_link));
+		if(!link)
+			return;
+		link->sink = sink;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		enqueue(&source->links, &link->q);
+	}
+}
+
+__kernel void
+clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
+		struct clTree_link __global *data, unsigned int items,
+		uintptr_t __local *rMem)
 {
 	struct clArrayList __global *atree = (struct clArrayList __global *) al;
 	struct clArrayList __global *alinks = (struct clArrayList __global *) alLink;
@@ -182,7 +514,6 @@ clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
 	struct clTree __global *tree = (struct clTree __global *)pTree;
 	size_t pid = 0, stride;
 	unsigned int i, alloc, itemsCeil;
-	uintptr_t __local rMem[128];
 	uintptr_t node;
 	struct clTree_link __global *item;
 	struct clGraph_link __global *link;
@@ -227,6 +558,7 @@ clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
 
 			source->tree.key = item->source;
 			clQueue_init(&source->links);
+			source->adj = NULL;
 			mem_fence(CLK_GLOBAL_MEM_FENCE);
 			if(!clTree_add(tree, &source->tree)) {
 				cache = source;
@@ -253,6 +585,7 @@ clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
 
 			sink->tree.key = item->sink;
 			clQueue_init(&sink->links);
+			sink->adj = NULL;
 			mem_fence(CLK_GLOBAL_MEM_FENCE);
 			if(!clTree_add(tree, &sink->tree)) {
 				cache = sink;
@@ -271,3 +604,431 @@ clTree_test_al(void __global *al, void __global *alLink, void __global *pTree,
 		enqueue(&source->links, &link->q);
 	}
 }
+
+/* Look up both ends of every link, one at a time */
+__kernel void
+clTree_test_get(void __global *pTree, struct clTree_link __global *data,
+		unsigned int items, unsigned int __global *found)
+{
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	size_t pid = 0, stride;
+	unsigned int i, hits = 0;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < items; i += stride) {
+		if(clTree_get(tree, data[i].source))
+			hits++;
+		if(clTree_get(tree, data[i].sink))
+			hits++;
+	}
+
+	atom_add(found, hits);
+}
+
+/* Same, batched per work-group */
+__kernel void
+clTree_test_get_many(void __global *pTree, struct clTree_link __global *data,
+		unsigned int items, unsigned int __global *found,
+		uint2 __local *sort, uintptr_t __local *res)
+{
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	size_t pid = 0, stride;
+	unsigned int i, itemsCeil, hits = 0;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	/* Everyone takes part in every batch */
+	itemsCeil = items % stride;
+	if(itemsCeil)
+		itemsCeil = stride - itemsCeil;
+	itemsCeil += items;
+
+	for(i = pid; i < itemsCeil; i += stride) {
+		if(clTree_get_many(tree, i < items ? data[i].source : 0xffffffff,
+				sort, res))
+			hits++;
+		if(clTree_get_many(tree, i < items ? data[i].sink : 0xffffffff,
+				sort, res))
+			hits++;
+	}
+
+	atom_add(found, hits);
+}
+
+/* Same, through the top CLTREE_CACHE_LEVELS levels in local memory */
+__kernel void
+clTree_test_get_cached(void __global *pTree, struct clTree_link __global *data,
+		unsigned int items, unsigned int __global *found)
+{
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	unsigned int __local keys[(1 << CLTREE_CACHE_LEVELS) - 1];
+	uintptr_t __local nodes[(2 << CLTREE_CACHE_LEVELS) - 1];
+	size_t pid = 0, stride;
+	unsigned int i, hits = 0;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	clTree_cache_load(tree, keys, nodes, CLTREE_CACHE_LEVELS);
+
+	for(i = pid; i < items; i += stride) {
+		if(clTree_get_cached(data[i].source, keys, nodes,
+				CLTREE_CACHE_LEVELS))
+			hits++;
+		if(clTree_get_cached(data[i].sink, keys, nodes,
+				CLTREE_CACHE_LEVELS))
+			hits++;
+	}
+
+	atom_add(found, hits);
+}
+
+/* Build the tree in one go from sorted unique keys */
+__kernel void
+clTree_test_build_balanced(void __global *pTree, unsigned int __global *keys,
+		unsigned int n, void __global *pNodes)
+{
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	struct clGraph_node __global *nodes = (struct clGraph_node __global *)pNodes;
+	size_t pid = 0, stride;
+	unsigned int i;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		clQueue_init(&nodes[i].links);
+		nodes[i].adj = NULL;
+	}
+
+	clTree_build_balanced(tree, keys, n, (char __global *) nodes,
+			sizeof(struct clGraph_node));
+}
+
+/* Delete the source of every even link, then unlink what has become a leaf */
+__kernel void
+clTree_test_delete(void __global *epoch, void __global *pTree,
+		struct clTree_link __global *data, unsigned int items,
+		unsigned int __global *deleted)
+{
+	struct clTree __global *tree = (struct clTree __global *)pTree;
+	size_t pid = 0, stride;
+	unsigned int i, del = 0;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+#ifdef KMA_H
+	kma_epoch_enter((struct kma_epoch __global *) epoch);
+#endif
+	for(i = pid << 1; i < items; i += stride << 1) {
+		if(clTree_delete(tree, data[i].source))
+			del++;
+	}
+	barrier(CLK_GLOBAL_MEM_FENCE);
+
+	for(i = pid << 1; i < items; i += stride << 1)
+		clTree_unlink(tree, data[i].source, epoch);
+#ifdef KMA_H
+	kma_epoch_exit((struct kma_epoch __global *) epoch);
+#endif
+
+	atom_add(deleted, del);
+}
+
+/* Collect all live nodes with lo <= key <= hi */
+__kernel void
+clTree_test_scan(void __global *pTree, unsigned int lo, unsigned int hi,
+		char __global *arrayList)
+{
+	clTree_scan((struct clTree __global *) pTree, lo, hi,
+			(clArrayList __global *) arrayList);
+}
+
+/*
+ * Sort-based graph build: node IDs are the ranks of the unique endpoints,
+ * edges are sorted by source ID into a CSR layout. No malloc, no tree.
+ */
+
+/* Copy all endpoints, remembering where each came from */
+__kernel void
+clGraph_sort_init(unsigned int __global *data, unsigned int n,
+		unsigned int __global *keys, unsigned int __global *pos)
+{
+	size_t pid = 0, stride;
+	unsigned int i;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		keys[i] = data[i];
+		pos[i] = i;
+	}
+}
+
+/* Hand out node IDs from the scanned marks of the sorted endpoints, split the
+ * edges back into source and sink IDs */
+__kernel void
+clGraph_sort_ids(unsigned int __global *keys, unsigned int __global *pos,
+		unsigned int n, unsigned int __global *marks,
+		unsigned int __global *src, unsigned int __global *dst,
+		unsigned int __global *nodeKeys)
+{
+	size_t pid = 0, stride;
+	unsigned int i, p, id;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		id = marks[i + 1] - 1;
+		if(marks[i] != marks[i + 1])
+			nodeKeys[id] = keys[i];
+
+		p = pos[i];
+		if(p & 1)
+			dst[p >> 1] = id;
+		else
+			src[p >> 1] = id;
+	}
+}
+
+/* First edge of every node in the source-sorted edge list, offsets[nodes]
+ * ends up as the number of edges */
+__kernel void
+clGraph_sort_offsets(unsigned int __global *src, unsigned int edges,
+		unsigned int nodes, unsigned int __global *offsets)
+{
+	size_t pid = 0, stride;
+	unsigned int i, lo, hi, mid;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i <= nodes; i += stride) {
+		lo = 0;
+		hi = edges;
+		while(lo < hi) {
+			mid = lo + ((hi - lo) >> 1);
+			if(src[mid] < i)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		offsets[i] = lo;
+	}
+}
+
+/*
+ * CSR export of a pointer-based graph. csr holds nodes + 1 offsets followed
+ * by the sink IDs. nodes is a flattened clArrayList from clTree_scan.
+ */
+
+/* Number the nodes in list order and count their links */
+__kernel void
+clGraph_csr_degree(uintptr_t __global *nodes, unsigned int n,
+		unsigned int __global *csr)
+{
+	struct clGraph_node __global *node;
+	uintptr_t it;
+	size_t pid = 0, stride;
+	unsigned int i, slot, deg;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		node = (struct clGraph_node __global *) nodes[i];
+		node->id = i;
+
+		deg = 0;
+		it = NULL;
+		while(clGraph_sink_next(node, &it, &slot) != NULL)
+			deg++;
+		csr[i] = deg;
+	}
+}
+
+/* With the degrees prefix summed, write out the sink IDs */
+__kernel void
+clGraph_csr_fill(uintptr_t __global *nodes, unsigned int n,
+		unsigned int __global *csr)
+{
+	struct clGraph_node __global *node, *sink;
+	unsigned int __global *sinks = &csr[n + 1];
+	uintptr_t it;
+	size_t pid = 0, stride;
+	unsigned int i, j, slot;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		node = (struct clGraph_node __global *) nodes[i];
+
+		j = csr[i];
+		it = NULL;
+		while((sink = clGraph_sink_next(node, &it, &slot)) != NULL)
+			sinks[j++] = sink->id;
+	}
+}
+
+/*
+ * Traversal of the pointer-based graph. Nodes are numbered by
+ * clGraph_csr_degree, per-node state lives in arrays indexed by id.
+ * stats[0] counts nodes added to the next frontier, stats[1] edges visited.
+ */
+
+/* Mark every node unvisited but the root, which makes up the first frontier */
+__kernel void
+clGraph_bfs_init(uintptr_t __global *nodes, unsigned int n,
+		unsigned int __global *level, void __global *frontier,
+		unsigned int root)
+{
+	size_t pid = 0, stride;
+	unsigned int i;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		level[i] = (i == root) ? 0 : 0xffffffff;
+		if(i == root)
+			ring_enqueue((clRingQueue __global *) frontier, nodes[i]);
+	}
+}
+
+/* Expand one level, the first to reach a node claims it for the next */
+__kernel void
+clGraph_bfs(void __global *in, void __global *out,
+		unsigned int __global *level, unsigned int depth,
+		unsigned int __global *stats)
+{
+	clRingQueue __global *qIn = (clRingQueue __global *) in;
+	clRingQueue __global *qOut = (clRingQueue __global *) out;
+	struct clGraph_node __global *node, *sink;
+	uintptr_t it;
+	unsigned int found = 0, edges = 0, slot;
+
+	while((node = (struct clGraph_node __global *) ring_dequeue(qIn)) != NULL) {
+		it = NULL;
+		while((sink = clGraph_sink_next(node, &it, &slot)) != NULL) {
+			edges++;
+			if(atom_cmpxchg(&level[sink->id], 0xffffffff, depth + 1) ==
+					0xffffffff) {
+				ring_enqueue(qOut, (uintptr_t) sink);
+				found++;
+			}
+		}
+	}
+
+	atom_add(&stats[0], found);
+	atom_add(&stats[1], edges);
+}
+
+/* No float atomics in OpenCL 1.x */
+void
+_clGraph_add_float(volatile float __global *f, float v)
+{
+	unsigned int old, nu;
+
+	do {
+		old = as_uint(*f);
+		nu = as_uint(as_float(old) + v);
+	} while(atom_cmpxchg((volatile unsigned int __global *) f, old, nu) != old);
+}
+
+__kernel void
+clGraph_pr_init(unsigned int n, float __global *rank, float __global *next)
+{
+	size_t pid = 0, stride;
+	unsigned int i;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		rank[i] = 1.0f / n;
+		next[i] = 0.0f;
+	}
+}
+
+/* Push every node's rank along its links, deg from clGraph_csr_degree */
+__kernel void
+clGraph_pr_push(uintptr_t __global *nodes, unsigned int n,
+		unsigned int __global *deg, float __global *rank,
+		float __global *next, unsigned int __global *stats)
+{
+	struct clGraph_node __global *node, *sink;
+	uintptr_t it;
+	size_t pid = 0, stride;
+	unsigned int i, slot, edges = 0;
+	float share;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		if(deg[i] == 0)
+			continue;
+
+		node = (struct clGraph_node __global *) nodes[i];
+		share = rank[i] / deg[i];
+		it = NULL;
+		while((sink = clGraph_sink_next(node, &it, &slot)) != NULL) {
+			edges++;
+			_clGraph_add_float(&next[sink->id], share);
+		}
+	}
+
+	atom_add(&stats[1], edges);
+}
+
+/* Rank of dangling nodes is dropped rather than spread out */
+__kernel void
+clGraph_pr_update(unsigned int n, float damping, float __global *rank,
+		float __global *next)
+{
+	size_t pid = 0, stride;
+	unsigned int i;
+
+	for(i = 0, stride = 1; i < get_work_dim(); i++) {
+		pid += stride * get_global_id(i);
+		stride *= get_global_size(i);
+	}
+
+	for(i = pid; i < n; i += stride) {
+		rank[i] = (1.0f - damping) / n + damping * next[i];
+		next[i] = 0.0f;
+	}
+}
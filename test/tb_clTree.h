@@ -28,9 +28,22 @@ struct clTree_link {
 	unsigned int source, sink;
 };
 
+/* Sinks per adjacency block, makes a block 128 bytes on 64-bit devices and
+ * 64 on 32-bit ones */
+#define CLGRAPH_ADJ_SLOTS 14
+
 struct clGraph_node {
 	struct clTree_node tree;
 	clqueue links;
+	volatile uintptr_t adj;	/**< Newest struct clGraph_adj */
+	unsigned int id;	/**< Row in the CSR export */
+};
+
+/* A block of sinks, chained newest first */
+struct clGraph_adj {
+	struct clGraph_adj __global *next;
+	volatile unsigned int fill;	/**< Slots taken, may exceed the count */
+	struct clGraph_node __global *sink[CLGRAPH_ADJ_SLOTS];
 };
 
 struct clGraph_link {
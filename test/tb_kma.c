@@ -226,7 +226,9 @@ kma_test_malloc(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	cl_int error;
 	unsigned int i, t, threads, its;
 	cl_mem heap;
+	cl_event ev;
 	cl_kernel kernel, detect_orphans;
+	char name[64];
 
 	qBack = calloc(KMA_SB_SIZE, 64);
 
@@ -258,9 +260,9 @@ kma_test_malloc(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 
 		for(; its <= iters; its += step) {
 			clSetKernelArg(kernel, 1, sizeof(cl_uint), &its);
-			for(i = 0; i < tSamples; i++) {
+			for(i = 0; i < tRuns; i++) {
 				tStart();
-				error = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[t].x, NULL, 0, NULL, NULL);
+				error = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[t].x, NULL, 0, NULL, &ev);
 				if (error != CL_SUCCESS) {
 					printf("KMA_test: Could not execute size test kernel: %i\n", error);
 					return -1;
@@ -271,6 +273,7 @@ kma_test_malloc(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 					printf("KMA_test: Size test kernel did not finish: %i\n", error);
 					return -1;
 				}
+				tEvent(ev);
 				tEnd(i);
 
 				error = clEnqueueReadBuffer(cq, heap, 0, 0, KMA_SB_SIZE * 15 + sizeof(struct kma_heap_32), qBack, 0, NULL, NULL);
@@ -282,7 +285,8 @@ kma_test_malloc(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 			}
 			threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
 			printf("%-5u threads %-5u iters: ", threads, its);
-			tPrint();
+			snprintf(name, sizeof(name), "%s/%u", krnl, its);
+			tPrint(name, threads);
 			//printf("WG Size: %d\n", qBack[14]);
 
 			if(its == 2 && step > 2)
@@ -319,6 +323,121 @@ kma_test_malloc(cl_device_id cid, cl_context ctx, cl_command_queue cq,
 	return 0;
 }
 
+int
+kma_test_deferred(cl_device_id cid, cl_context ctx, cl_command_queue cq,
+		cl_program prg)
+{
+	cl_int error;
+	unsigned int i, t, threads;
+	cl_mem heap, ep, cnt;
+	cl_event ev;
+	cl_kernel kernel, flush, count;
+	cl_uint cntBack[2];
+	size_t one = 1;
+
+	heap = kma_create(cid, ctx, cq, prg, 127);
+	if(!heap)
+		return -1;
+
+	kernel = clCreateKernel(prg, "kma_test_free_deferred", &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA_test: Could not create deferred free kernel: %i\n", error);
+		return -1;
+	}
+
+	flush = clCreateKernel(prg, "kma_epoch_flush", &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA_test: Could not create epoch flush kernel: %i\n", error);
+		return -1;
+	}
+
+	count = clCreateKernel(prg, "kma_test_count_free", &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA_test: Could not create free count kernel: %i\n", error);
+		return -1;
+	}
+
+	cnt = clCreateBuffer(ctx, CL_MEM_READ_WRITE, 2 * sizeof(cl_uint), NULL, &error);
+	if(error != CL_SUCCESS) {
+		printf("KMA_test: Could not create count buffer: %i\n", error);
+		return -1;
+	}
+	clSetKernelArg(count, 0, sizeof(cl_mem), &heap);
+	clSetKernelArg(count, 1, sizeof(cl_mem), &cnt);
+
+	printf("-- Executing kma_test_free_deferred --\n");
+	for(t = 0; t < options.wi_entries; t++) {
+		/* Work-group size is up to the implementation, so reserve a
+		 * record for every work-item to be safe */
+		threads = options.wi[t].x * options.wi[t].y * options.wi[t].z;
+		ep = kma_epoch_create(cid, ctx, cq, prg, heap, threads);
+		if(!ep)
+			return -1;
+
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &heap);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &ep);
+		clSetKernelArg(kernel, 2, sizeof(cl_uint), &iters);
+		clSetKernelArg(flush, 0, sizeof(cl_mem), &ep);
+
+		for(i = 0; i < tRuns; i++) {
+			tStart();
+			error = clEnqueueNDRangeKernel(cq, kernel, 3, NULL, &options.wi[t].x, NULL, 0, NULL, &ev);
+			if (error != CL_SUCCESS) {
+				printf("KMA_test: Could not execute deferred free kernel: %i\n", error);
+				return -1;
+			}
+
+			error = clFinish(cq);
+			if (error != CL_SUCCESS) {
+				printf("KMA_test: Deferred free kernel did not finish: %i\n", error);
+				return -1;
+			}
+			tEvent(ev);
+			tEnd(i);
+
+			/* Return whatever is left on the retire lists */
+			error = clEnqueueNDRangeKernel(cq, flush, 3, NULL, &options.wi[t].x, NULL, 0, NULL, NULL);
+			error |= clFinish(cq);
+			if (error != CL_SUCCESS) {
+				printf("KMA_test: Could not flush retire lists: %i\n", error);
+				return -1;
+			}
+
+			/* Every block must be back, so every superblock free */
+			if(kma_epoch_overflowed(cid, cq, ep)) {
+				printf("KMA_test: More work-groups than epoch records\n");
+				return -1;
+			}
+
+			error = clEnqueueNDRangeKernel(cq, count, 1, NULL, &one, NULL, 0, NULL, NULL);
+			error |= clEnqueueReadBuffer(cq, cnt, CL_TRUE, 0, 2 * sizeof(cl_uint),
+					cntBack, 0, NULL, NULL);
+			if (error != CL_SUCCESS) {
+				printf("KMA_test: Could not count free superblocks: %i\n", error);
+				return -1;
+			}
+			if(cntBack[0] != cntBack[1]) {
+				printf("KMA_test: Heap not empty after flush: %u of %u "
+						"superblocks free\n", cntBack[0], cntBack[1]);
+				return -1;
+			}
+		}
+		printf("%-5u threads %-5u iters: ", threads, iters);
+		tPrint("kma_test_free_deferred", threads);
+
+		clReleaseMemObject(ep);
+	}
+
+	clReleaseKernel(kernel);
+	clReleaseKernel(flush);
+	clReleaseKernel(count);
+	clReleaseMemObject(cnt);
+	clReleaseMemObject(heap);
+	printf("\n");
+
+	return 0;
+}
+
 int
 kma_opts(unsigned int i, unsigned int argc, char **argv)
 {
@@ -406,6 +525,8 @@ main(int argc, char** argv) {
 	kma_test_malloc(cid, ctx, cq, prg, "kma_test_malloc");
 	kma_test_malloc(cid, ctx, cq, prg, "kma_test_malloc_lowvar");
 	kma_test_malloc(cid, ctx, cq, prg, "kma_test_malloc_highvar");
+	if(kma_test_deferred(cid, ctx, cq, prg))
+		return -1;
 
 	free(src[0]);
 	free(src[1]);
@@ -1,6 +1,6 @@
 /**
  * timing.c
- * Library for obtaining wall-clock time and calculating averages
+ * Library for obtaining wall-clock and kernel time and calculating statistics
  * Copyright (C) 2013-2014 Roy Spliet, Delft University of Technology
  *
  * This library is free software; you can redistribute it and/or
@@ -19,6 +19,7 @@
  * USA
  */
 #include <sys/time.h>
+#include <time.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -28,96 +29,230 @@
 
 #include "timing.h"
 
-struct timeval tstart, tend;
-uint64_t tSample[tSamples];
-int tStep;
+unsigned int tSamples = 1;
+unsigned int tWarmup = 0;
 
-uint64_t
-tMin(uint64_t *pTList, int pLen) {
-	int i;
-	uint64_t retval = pTList[0];
+uint64_t tstart;
+uint64_t *tWall, *tDev;
+unsigned int tCount, tCap, tDevMissing;
+uint64_t tDevRun;
+int tDevSeen;
 
-	for(i = 0; i < pLen; i++) {
-		if(retval > pTList[i])
-			retval = pTList[i];
-	}
-	return retval;
+static FILE *tFile;
+static int tFormat;
+
+struct tStats {
+	uint64_t avg, min, max, median, p95, p99, stddev, total;
+};
+
+static int
+_tCmp(const void *a, const void *b)
+{
+	uint64_t l = *(const uint64_t *) a, r = *(const uint64_t *) b;
+
+	return (l > r) - (l < r);
 }
 
-uint64_t
-tMax(uint64_t *pTList, int pLen) {
+/* Nearest-rank percentile of sorted samples */
+static uint64_t
+_tPercentile(uint64_t *pSorted, int pLen, int pPct)
+{
+	int rank;
+
+	rank = (pPct * pLen + 99) / 100;
+	if(rank < 1)
+		rank = 1;
+	return pSorted[rank - 1];
+}
+
+static void
+_tStats(uint64_t *pTList, int pLen, struct tStats *st)
+{
+	uint64_t *sorted;
+	double mean, var = 0., d;
 	int i;
-	uint64_t retval = pTList[0];
 
+	memset(st, 0, sizeof(struct tStats));
+	if(pLen == 0)
+		return;
+
+	sorted = malloc(pLen * sizeof(uint64_t));
+	memcpy(sorted, pTList, pLen * sizeof(uint64_t));
+	qsort(sorted, pLen, sizeof(uint64_t), _tCmp);
+
+	for(i = 0; i < pLen; i++)
+		st->total += sorted[i];
+	mean = (double) st->total / pLen;
 	for(i = 0; i < pLen; i++) {
-		if(retval < pTList[i])
-			retval = pTList[i];
+		d = sorted[i] - mean;
+		var += d * d;
 	}
-	return retval;
+	if(pLen > 1)
+		var /= pLen - 1;
+
+	st->avg = st->total / pLen;
+	st->min = sorted[0];
+	st->max = sorted[pLen - 1];
+	st->median = _tPercentile(sorted, pLen, 50);
+	st->p95 = _tPercentile(sorted, pLen, 95);
+	st->p99 = _tPercentile(sorted, pLen, 99);
+	st->stddev = (uint64_t) sqrt(var);
+
+	free(sorted);
 }
 
-uint64_t
-tAvg(uint64_t *pTList, int pLen) {
-	// Reduce by 10 every iteration
-	int i,j,jsteps;
-	uint64_t curSample;
-	uint64_t* mySamples;
-
-	mySamples = malloc(tSamples*sizeof(uint64_t));
-	memcpy(mySamples,pTList,pLen*sizeof(uint64_t));
-
-	for(i = 0; i < tSamples_baseten; i++) {
-		jsteps = tSamples / pow(10,i+1);
-		for(j = 0; j < jsteps; j++) {
-			curSample = mySamples[j*10];
-			curSample +=	mySamples[(j*10)+1];
-			curSample +=	mySamples[(j*10)+2];
-			curSample +=	mySamples[(j*10)+3];
-			curSample +=	mySamples[(j*10)+4];
-			curSample +=	mySamples[(j*10)+5];
-			curSample +=	mySamples[(j*10)+6];
-			curSample +=	mySamples[(j*10)+7];
-			curSample +=	mySamples[(j*10)+8];
-			curSample +=	mySamples[(j*10)+9];
-			mySamples[j] = curSample / 10;
-		}
-	}
+static uint64_t
+_tNow()
+{
+	struct timespec t;
 
-	curSample = mySamples[0];
-	free(mySamples);
-	return curSample;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
-/* If it fits... */
-uint64_t
-tTotal(uint64_t* pTList, int pLen) {
-	int i;
-	uint64_t retval = 0;
+static void
+_tRecord(uint64_t pWall)
+{
+	if(tCount == tCap) {
+		tCap = tCap ? tCap * 2 : 16;
+		tWall = realloc(tWall, tCap * sizeof(uint64_t));
+		tDev = realloc(tDev, tCap * sizeof(uint64_t));
+	}
+	tWall[tCount] = pWall;
+	tDev[tCount] = tDevRun;
+	if(!tDevSeen)
+		tDevMissing++;
+	tCount++;
+}
 
-	for(i = 0; i < pLen; i++) {
-		retval += pTList[i];
+int
+tOutput(const char *file)
+{
+	size_t len = strlen(file);
+
+	tFile = fopen(file, "a");
+	if(!tFile) {
+		printf("Error: Could not open %s\n", file);
+		return -1;
+	}
+
+	if(len > 5 && !strcmp(&file[len - 5], ".json")) {
+		tFormat = T_FORMAT_JSON;
+	} else {
+		tFormat = T_FORMAT_CSV;
+		if(ftell(tFile) == 0)
+			fprintf(tFile, "name,threads,source,runs,warmup,avg_ns,"
+					"min_ns,max_ns,median_ns,p95_ns,p99_ns,"
+					"stddev_ns,total_ns,wall_median_ns\n");
 	}
-	return retval;
+	return 0;
 }
 
 void
 tStart() {
-	gettimeofday(&tstart,NULL);
+	tDevRun = 0;
+	tDevSeen = 0;
+	tstart = _tNow();
+}
+
+void
+tEvent(cl_event ev) {
+	cl_ulong start, end;
+	cl_int err;
+
+	err = clWaitForEvents(1, &ev);
+	err |= clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START,
+			sizeof(cl_ulong), &start, NULL);
+	err |= clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END,
+			sizeof(cl_ulong), &end, NULL);
+	if(err == CL_SUCCESS) {
+		tDevRun += end - start;
+		tDevSeen = 1;
+	}
+	clReleaseEvent(ev);
 }
 
 void
 tEnd(int pI) {
-	gettimeofday(&tend,NULL);
-	tSample[pI] = (tend.tv_sec * 1000000 + tend.tv_usec) - (tstart.tv_sec * 1000000 + tstart.tv_usec);
+	uint64_t wall = _tNow() - tstart;
+
+	if(pI < (int) tWarmup)
+		return;
+	_tRecord(wall);
+}
+
+void
+tEndSingle() {
+	_tRecord(_tNow() - tstart);
+}
+
+static void
+_tPrintTime(const char *label, uint64_t ns) {
+	printf("%s%"PRIu64".%09"PRIu64, label, ns / 1000000000, ns % 1000000000);
 }
 
 void
-tPrint() {
-	uint64_t avg,min,max,total;
-
-	avg = tAvg(tSample,tSamples);
-	min = tMin(tSample,tSamples);
-	max = tMax(tSample,tSamples);
-	total = tTotal(tSample,tSamples);
-	printf("Avg: %"PRIu64".%06"PRIu64" ( %"PRIu64".%06"PRIu64" - %"PRIu64".%06"PRIu64" ) Total: %"PRIu64".%06"PRIu64"\n",avg/1000000,avg%1000000,min/1000000,min%1000000,max/1000000,max%1000000,total/1000000,total%1000000);
+tPrint(const char *name, uint64_t threads) {
+	struct tStats st, wall;
+	const char *src;
+
+	/* Kernel time only if no run lacks it */
+	if(tCount && tDevMissing == 0) {
+		_tStats(tDev, tCount, &st);
+		src = "kernel";
+	} else {
+		_tStats(tWall, tCount, &st);
+		src = "wall";
+	}
+	_tStats(tWall, tCount, &wall);
+
+	_tPrintTime("Avg: ", st.avg);
+	_tPrintTime(" ( ", st.min);
+	_tPrintTime(" - ", st.max);
+	_tPrintTime(" ) Median: ", st.median);
+	_tPrintTime(" p95: ", st.p95);
+	_tPrintTime(" p99: ", st.p99);
+	_tPrintTime(" Stddev: ", st.stddev);
+	_tPrintTime(" Total: ", st.total);
+	printf(" (%s, %u runs)\n", src, tCount);
+
+	if(tFile && tFormat == T_FORMAT_JSON) {
+		fprintf(tFile, "{\"name\": \"%s\", \"threads\": %"PRIu64", "
+				"\"source\": \"%s\", \"runs\": %u, \"warmup\": %u, "
+				"\"avg_ns\": %"PRIu64", \"min_ns\": %"PRIu64", "
+				"\"max_ns\": %"PRIu64", \"median_ns\": %"PRIu64", "
+				"\"p95_ns\": %"PRIu64", \"p99_ns\": %"PRIu64", "
+				"\"stddev_ns\": %"PRIu64", \"total_ns\": %"PRIu64", "
+				"\"wall_median_ns\": %"PRIu64"}\n", name, threads,
+				src, tCount, tWarmup, st.avg, st.min, st.max,
+				st.median, st.p95, st.p99, st.stddev, st.total,
+				wall.median);
+		fflush(tFile);
+	} else if(tFile) {
+		fprintf(tFile, "%s,%"PRIu64",%s,%u,%u,%"PRIu64",%"PRIu64",%"
+				PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64
+				",%"PRIu64",%"PRIu64"\n", name, threads, src,
+				tCount, tWarmup, st.avg, st.min, st.max,
+				st.median, st.p95, st.p99, st.stddev, st.total,
+				wall.median);
+		fflush(tFile);
+	}
+
+	/* Next measurement starts afresh */
+	tCount = 0;
+	tDevMissing = 0;
+}
+
+/* Print items per second, based on the median run */
+void
+tPrintRate(uint64_t items, const char *unit) {
+	struct tStats st;
+
+	if(tCount && tDevMissing == 0)
+		_tStats(tDev, tCount, &st);
+	else
+		_tStats(tWall, tCount, &st);
+	if(st.median == 0)
+		st.median = 1;
+	printf("%.3f M%s/s ", (double) items * 1000. / st.median, unit);
 }
@@ -23,16 +23,60 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <CL/opencl.h>
 
-// tSamples in
-#define tSamples_baseten 0
-#define tSamples 1
+/* Record formats for tOutput */
+#define T_FORMAT_CSV 0
+#define T_FORMAT_JSON 1
+
+/* Runs per measurement, set from the command line. The first tWarmup runs
+ * are thrown away. */
+extern unsigned int tSamples;
+extern unsigned int tWarmup;
+#define tRuns (tWarmup + tSamples)
+
+/**
+ * tOutput() - Append a record per tPrint to a file as well
+ * @file: File name, ending in .json for JSON lines, CSV otherwise
+ * @return: 0 on success, -1 if the file can't be opened
+ */
+int
+tOutput(const char *file);
 
 void
 tStart();
 
+/**
+ * tEvent() - Account the execution time of a finished command to the
+ * current run, then release it
+ * @ev: Event of a command on a queue with CL_QUEUE_PROFILING_ENABLE
+ */
+void
+tEvent(cl_event ev);
+
+/**
+ * tEnd() - End run @pI, runs below tWarmup are discarded
+ */
 void
 tEnd(int pI);
 
+/**
+ * tEndSingle() - End a measurement that can't be repeated, kept regardless
+ * of warm-up
+ */
+void
+tEndSingle();
+
+/**
+ * tPrint() - Print statistics over the runs since the last tPrint
+ * @name: Kernel or operation, for the records
+ * @threads: Number of work-items, for the records
+ *
+ * Kernel time from tEvent is reported when every run has it, wall-clock
+ * time otherwise.
+ */
+void
+tPrint(const char *name, uint64_t threads);
+
 void
-tPrint();
+tPrintRate(uint64_t items, const char *unit);